@@ -0,0 +1,105 @@
+#! /usr/bin/env python3
+#
+# Compares replacement policies against LRU on the bundled traces. For every
+# trace and cache geometry, each policy is simulated and its hit ratio and
+# simulation speed are reported next to the difference from LRU.
+#
+# Usage:
+#      bin/compare_policies.py [-p POLICY,...] [-g SIZE:LINES:ASSOC ...] [-r RUNS]
+#
+# The speed is the best of RUNS runs of `cachesim --quiet`, in millions of
+# accesses per second, and includes reading and parsing the trace.
+
+import argparse
+import os
+import re
+import subprocess
+import time
+from pathlib import Path
+
+root = os.getcwd()
+inputs_dir = Path(root, "inputs")
+
+parser = argparse.ArgumentParser(description="Compare replacement policies against LRU.")
+parser.add_argument(
+    "-p",
+    "--policies",
+    default="PLRU_TREE,PLRU_BIT",
+    help="comma-separated policies to compare against LRU (default: PLRU_TREE,PLRU_BIT)",
+)
+parser.add_argument(
+    "-g",
+    "--geometry",
+    action="append",
+    help="a SIZE:LINES:ASSOC cache geometry; may be repeated "
+    "(default: 1024:128:4, 32768:2048:8 and 65536:1024:64)",
+)
+parser.add_argument(
+    "-r", "--runs", type=int, default=5, help="runs per configuration to time (default: 5)"
+)
+args = parser.parse_args()
+
+policies = ["LRU", *(p for p in args.policies.split(",") if p and p != "LRU")]
+geometries = [g.split(":") for g in args.geometry or ["1024:128:4", "32768:2048:8", "65536:1024:64"]]
+
+
+# Utilities
+# ======================================================================================
+class bcolors:
+    BOLD = "\033[1m"
+    OKGREEN = "\033[92m"
+    FAIL = "\033[91m"
+    ENDC = "\033[0m"
+
+
+def run_sim(policy, geometry, inputfile):
+    # Run the simulation a few times, keeping the fastest run.
+    best = None
+    for _ in range(args.runs):
+        start = time.perf_counter()
+        sim_process = subprocess.run(
+            ["./cachesim", "--quiet", "--trace", str(inputfile), policy, *geometry, "NULL", "0"],
+            stdout=subprocess.PIPE,
+        )
+        elapsed = time.perf_counter() - start
+        if sim_process.returncode != 0:
+            return None
+        best = elapsed if best is None else min(best, elapsed)
+
+    # Pull the statistics out of the OUTPUT lines.
+    stats = {}
+    for line in sim_process.stdout.decode().split("\n"):
+        match = re.match(r"OUTPUT (.+?) (\S+)$", line)
+        if match:
+            stats[match.group(1)] = float(match.group(2))
+    return stats, best
+
+
+# Run the comparison
+# ======================================================================================
+print(
+    f"{bcolors.BOLD}{'TRACE':8} {'GEOMETRY':16} {'POLICY':12} {'HIT_RATIO':>10} "
+    f"{'DELTA':>9} {'MACC/S':>8} {'SPEEDUP':>8}{bcolors.ENDC}"
+)
+for infile in sorted(inputs_dir.iterdir()):
+    for geometry in geometries:
+        lru_hit_ratio = lru_time = None
+        for policy in policies:
+            result = run_sim(policy, geometry, infile)
+            if result is None:
+                print(f"{infile.name:8} {':'.join(geometry):16} {policy:12} {'(failed)':>10}")
+                continue
+            stats, elapsed = result
+            hit_ratio = stats["HIT RATIO"]
+            speed = stats["ACCESSES"] / elapsed / 1e6
+            if policy == "LRU":
+                lru_hit_ratio, lru_time = hit_ratio, elapsed
+
+            delta = hit_ratio - lru_hit_ratio if lru_hit_ratio is not None else 0
+            speedup = lru_time / elapsed if lru_time is not None else 1
+            color = bcolors.FAIL if delta < 0 else bcolors.OKGREEN if delta > 0 else ""
+            print(
+                f"{infile.name:8} {':'.join(geometry):16} {policy:12} {hit_ratio:10.6f} "
+                f"{color}{delta:+9.6f}{bcolors.ENDC if color else ''} {speed:8.2f} "
+                f"{speedup:7.2f}x"
+            )
@@ -0,0 +1,206 @@
+#! /usr/bin/env python3
+#
+# Measures how fast the simulator is. Every replacement policy is run with
+# every prefetcher over the bundled traces and over a few synthetic traces,
+# and the throughput (accesses per second and ns per access) and peak RSS of
+# each run are reported and saved as JSON.
+#
+# Usage:
+#      bin/run_bench.py [-b BINARY] [-p POLICY,...] [-f PREFETCHER,...]
+#                       [-g SIZE:LINES:ASSOC] [-n ACCESSES] [-r RUNS]
+#                       [-o OUTPUT] [-c BASELINE]
+#
+# `make bench` builds an optimized binary (cachesim-bench) and runs this. The
+# time of a configuration is the best of RUNS runs of `BINARY --quiet`, and
+# includes reading and parsing the trace. The results are written to
+# bench_results/<date>.json unless OUTPUT is given. With -c, the throughput of
+# each configuration is also compared against an earlier results file.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import tempfile
+import time
+from datetime import datetime
+from pathlib import Path
+
+root = os.getcwd()
+inputs_dir = Path(root, "inputs")
+results_dir = Path(root, "bench_results")
+
+POLICIES = "LRU,RAND,LRU_PREFER_CLEAN,PLRU_TREE,PLRU_BIT,SRRIP,BRRIP,DRRIP"
+PREFETCHERS = "NULL,ADJACENT,SEQUENTIAL,CUSTOM"
+
+parser = argparse.ArgumentParser(description="Measure the throughput of cachesim.")
+parser.add_argument(
+    "-b", "--binary", default="./cachesim-bench", help="simulator (default: ./cachesim-bench)"
+)
+parser.add_argument(
+    "-p", "--policies", default=POLICIES, help="comma-separated policies (default: all)"
+)
+parser.add_argument(
+    "-f", "--prefetchers", default=PREFETCHERS, help="comma-separated prefetchers (default: all)"
+)
+parser.add_argument(
+    "-g", "--geometry", default="32768:1024:8", help="SIZE:LINES:ASSOC (default: 32768:1024:8)"
+)
+parser.add_argument(
+    "-n",
+    "--accesses",
+    type=int,
+    default=1000000,
+    help="accesses per synthetic trace (default: 1000000)",
+)
+parser.add_argument(
+    "-r", "--runs", type=int, default=3, help="runs per configuration to time (default: 3)"
+)
+parser.add_argument("-o", "--output", help="where to write the JSON results")
+parser.add_argument("-c", "--compare", help="earlier JSON results to compare against")
+args = parser.parse_args()
+
+geometry = args.geometry.split(":")
+
+
+# Utilities
+# ======================================================================================
+class bcolors:
+    BOLD = "\033[1m"
+    OKGREEN = "\033[92m"
+    FAIL = "\033[91m"
+    ENDC = "\033[0m"
+
+
+# Synthetic traces
+# ======================================================================================
+# The traces come from `cachesim gen` (see src/tracegen.h). They are binary, so
+# that they measure the simulator rather than the text parser.
+SYNTHETIC = ["seq", "stride", "chase", "zipf", "mix"]
+
+
+def generate_trace(path, pattern):
+    subprocess.run(
+        [args.binary, "gen", "--seed", "1", "--accesses", str(args.accesses), "-o", path, pattern],
+        check=True,
+    )
+
+
+# Running
+# ======================================================================================
+def run_sim(trace, policy, prefetcher):
+    # Run the simulation a few times, keeping the fastest run and the largest
+    # peak RSS.
+    command = [args.binary, "--quiet", "--trace", str(trace), policy, *geometry, prefetcher, "2"]
+    best = peak_rss = None
+    for _ in range(args.runs):
+        with tempfile.TemporaryFile() as out:
+            start = time.perf_counter()
+            process = subprocess.Popen(command, stdout=out)
+            _, status, usage = os.wait4(process.pid, 0)
+            elapsed = time.perf_counter() - start
+            process.returncode = os.waitstatus_to_exitcode(status)
+            if process.returncode != 0:
+                return None
+            out.seek(0)
+            output = out.read().decode()
+        best = elapsed if best is None else min(best, elapsed)
+        peak_rss = usage.ru_maxrss if peak_rss is None else max(peak_rss, usage.ru_maxrss)
+
+    # Pull the statistics out of the OUTPUT lines.
+    stats = {}
+    for line in output.split("\n"):
+        match = re.match(r"OUTPUT (.+?) (\S+)$", line)
+        if match:
+            stats[match.group(1)] = float(match.group(2))
+    accesses = int(stats["ACCESSES"])
+    return {
+        "accesses": accesses,
+        "seconds": best,
+        "accesses_per_second": accesses / best,
+        "ns_per_access": best * 1e9 / accesses if accesses else 0,
+        "peak_rss_kb": peak_rss,  # ru_maxrss is in KiB on Linux
+        "hit_ratio": stats["HIT RATIO"],
+    }
+
+
+def key(result):
+    return (result["trace"], result["policy"], result["prefetcher"], result["geometry"])
+
+
+baseline = {}
+if args.compare:
+    with open(args.compare) as f:
+        baseline = {key(r): r for r in json.load(f)["results"]}
+
+print(
+    f"{bcolors.BOLD}{'TRACE':11} {'POLICY':17} {'PREFETCHER':11} {'MACC/S':>8} "
+    f"{'NS/ACC':>8} {'RSS_KB':>8}{' CHANGE' if baseline else ''}{bcolors.ENDC}"
+)
+
+results = []
+with tempfile.TemporaryDirectory() as tmp:
+    traces = [(p.name, p) for p in sorted(inputs_dir.glob("trace*"))]
+    for pattern in SYNTHETIC:
+        path = Path(tmp, pattern)
+        generate_trace(path, pattern)
+        traces.append((pattern, path))
+
+    for name, path in traces:
+        for policy in args.policies.split(","):
+            for prefetcher in args.prefetchers.split(","):
+                result = run_sim(path, policy, prefetcher)
+                if result is None:
+                    print(f"{name:11} {policy:17} {prefetcher:11} {'(failed)':>8}")
+                    continue
+                result = {
+                    "trace": name,
+                    "policy": policy,
+                    "prefetcher": prefetcher,
+                    "geometry": args.geometry,
+                    **result,
+                }
+                results.append(result)
+
+                change = ""
+                old = baseline.get(key(result))
+                if old:
+                    ratio = result["accesses_per_second"] / old["accesses_per_second"] - 1
+                    color = ""
+                    if ratio < -0.05:
+                        color = bcolors.FAIL
+                    elif ratio > 0.05:
+                        color = bcolors.OKGREEN
+                    change = f" {color}{ratio:+7.1%}{bcolors.ENDC if color else ''}"
+                print(
+                    f"{name:11} {policy:17} {prefetcher:11} "
+                    f"{result['accesses_per_second'] / 1e6:8.2f} {result['ns_per_access']:8.1f} "
+                    f"{result['peak_rss_kb']:8}{change}"
+                )
+
+# Save the results
+# ======================================================================================
+try:
+    commit = subprocess.run(
+        ["git", "rev-parse", "HEAD"], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL
+    ).stdout.decode().strip()
+except OSError:
+    commit = ""
+
+output_path = Path(args.output) if args.output else None
+if output_path is None:
+    results_dir.mkdir(exist_ok=True)
+    output_path = Path(results_dir, datetime.now().strftime("%Y-%m-%d-%H-%M-%S") + ".json")
+print(f"{bcolors.BOLD}Writing results to {output_path}{bcolors.ENDC}")
+with open(output_path, "w") as f:
+    json.dump(
+        {
+            "date": datetime.now().isoformat(timespec="seconds"),
+            "commit": commit,
+            "binary": args.binary,
+            "runs": args.runs,
+            "results": results,
+        },
+        f,
+        indent=2,
+    )
@@ -4,6 +4,7 @@ import json
 import os
 import re
 import subprocess
+import tempfile
 from collections import defaultdict
 from datetime import datetime
 from pathlib import Path
@@ -42,20 +43,65 @@ def test_results_add(number, name, output, score, max_score=1):
     )
 
 
-def run_sim(args, inputfile):
-    # Run the simulation.
+def run_cachesim(args, input_bytes=b""):
+    # Run cachesim with the given bytes on stdin, and return the lines it prints.
     sim_process = subprocess.Popen(
         ["./cachesim", *args],
         stdin=subprocess.PIPE,
         stdout=subprocess.PIPE,
     )
+    stdout, _ = sim_process.communicate(input_bytes)
+    return [line for line in stdout.decode().split("\n") if line]
+
 
+def run_sim(args, inputfile):
     # Pass in the input file on stdin.
     with open(inputfile, "rb") as i:
-        stdout, _ = sim_process.communicate(i.read())
+        output_lines = run_cachesim(args, i.read())
 
     # Return the lines that have OUTPUT at the beginning
-    return list(filter(lambda l: l.startswith("OUTPUT"), stdout.decode().split("\n")))
+    return list(filter(lambda l: l.startswith("OUTPUT"), output_lines))
+
+
+def check_output(
+    test_number, test_name, output_lines, expected_output_lines, max_score=1
+):
+    # Compare the output to the expected output line by line, print PASS or FAIL, and
+    # record the result. Returns whether they match.
+    if len(output_lines) != len(expected_output_lines):
+        print(f"{bcolors.BOLD}{bcolors.FAIL}FAIL{bcolors.ENDC}")
+        error_text = "      {} OUTPUT lines found, expected {}".format(
+            len(output_lines),
+            len(expected_output_lines),
+        )
+        print(error_text)
+        test_results_add(test_number, test_name, error_text, 0, max_score=max_score)
+        return False
+
+    # Check each of the output lines.
+    for i, (found, expected) in enumerate(zip(output_lines, expected_output_lines)):
+        if found != expected:
+            print(f"{bcolors.BOLD}{bcolors.FAIL}FAIL{bcolors.ENDC}")
+            error_text = "\n".join(
+                (
+                    f"      On line {i} found:",
+                    f"        {found}",
+                    "      expected:",
+                    f"        {expected}",
+                )
+            )
+            print(error_text)
+            test_results_add(test_number, test_name, error_text, 0, max_score=max_score)
+            return False
+
+    test_results_add(test_number, test_name, "PASS", max_score, max_score=max_score)
+    print(f"{bcolors.BOLD}{bcolors.OKGREEN}PASS{bcolors.ENDC}")
+    return True
+
+
+def read_expected(expected_file_path):
+    with open(expected_file_path) as ef:
+        return [line.strip() for line in ef.readlines()]
 
 
 def run_matrix_addition():
@@ -112,51 +158,136 @@ for infile in sorted(inputs_dir.iterdir()):
         test_name = expected_file_path.name
 
         output_lines = run_sim(["LRU", *map(str.upper, file_parts.groups())], infile)
+        check_output(
+            test_number,
+            test_name,
+            output_lines,
+            read_expected(expected_file_path),
+            max_score,
+        )
 
-        # Get the expected output.
-        with open(expected_file_path) as ef:
-            expected_output_lines = [line.strip() for line in ef.readlines()]
 
-        # Make sure everything matches up
-        if len(output_lines) != len(expected_output_lines):
-            print(f"{bcolors.BOLD}{bcolors.FAIL}FAIL{bcolors.ENDC}")
-            error_text = "      {} OUTPUT lines found, expected {}".format(
-                len(output_lines),
-                len(expected_output_lines),
-            )
-            print(error_text)
-            test_results_add(test_number, test_name, error_text, 0)
-            continue
-
-        # Check each of the output lines.
-        fail = False
-        for i, (found, expected) in enumerate(zip(output_lines, expected_output_lines)):
-            if found != expected:
-                print(f"{bcolors.BOLD}{bcolors.FAIL}FAIL{bcolors.ENDC}")
-                error_text = "\n".join(
-                    (
-                        f"      On line {i} found:",
-                        f"        {found}",
-                        "      expected:",
-                        f"        {expected}",
-                    )
-                )
-                print(error_text)
-                test_results_add(
-                    test_number,
-                    test_name,
-                    error_text,
-                    0,
-                    max_score=max_score
-                )
-                fail = True
-                break
+# Other replacement policies
+# ======================================================================================
+# The expected files are named POLICY-SIZE-LINES-ASSOC-PREFETCHER-AMOUNT-TRACE, and the
+# simulations use a fixed seed so that the random parts of the policies are repeatable.
+print(f"{bcolors.BOLD}Checking the other replacement policies.{bcolors.ENDC}")
+
+POLICY_SEED = "1"
+policy_cases = []
+policies_dir = Path(expected_dir, "policies")
+for i, expected_file_path in enumerate(sorted(policies_dir.iterdir())):
+    file_parts = re.match(
+        r"(\w+)-(\d+)-(\d+)-(\d+)-(\w+)-(\d+)-(\w+)", expected_file_path.name
+    )
+    args = [*map(str.upper, file_parts.groups()[:6])]
+    infile = Path(inputs_dir, file_parts.group(7))
+    policy_cases.append((expected_file_path, args, infile))
+
+    print(f"  Checking {infile} with parameters {' '.join(args)}...", end=" ")
+    output_lines = run_sim(["-s", POLICY_SEED, *args], infile)
+    check_output(
+        f"2.1.{i + 1}", expected_file_path.name, output_lines,
+        read_expected(expected_file_path),
+    )
+
+
+# Miss ratio curves
+# ======================================================================================
+# The expected files are named LINE_SIZE-SETS-TRACE and hold the CSV output of
+# `cachesim mrc`. Every point of the curve must also match an LRU simulation of the same
+# cache.
+print(f"{bcolors.BOLD}Checking miss ratio curves against LRU.{bcolors.ENDC}")
+
+for i, expected_file_path in enumerate(sorted(Path(expected_dir, "mrc").iterdir())):
+    file_parts = re.match(r"(\d+)-(\d+)-(\w+)", expected_file_path.name)
+    line_size, sets, trace = file_parts.groups()
+    infile = Path(inputs_dir, trace)
+    print(f"  Checking {infile} with {line_size}B lines and {sets} sets...", end=" ")
+    output_lines = run_cachesim(
+        ["mrc", "--csv", "-a", "8", "-t", str(infile), line_size, sets]
+    )
+    if not check_output(
+        f"2.2.{2 * i + 1}", expected_file_path.name, output_lines,
+        read_expected(expected_file_path),
+    ):
+        continue
+
+    print(f"  Checking {infile} LRU simulations at each point...", end=" ")
+    header = output_lines[0].split(",")
+    lru_lines, mrc_lines = [], []
+    for row in output_lines[1:]:
+        point = dict(zip(header, row.split(",")))
+        lru_output = run_sim(
+            ["LRU", point["cache_size"], point["cache_lines"], point["associativity"],
+             "NULL", "0"],
+            infile,
+        )
+        lru_lines += [l for l in lru_output if l.split()[1] in ("HITS", "MISSES")]
+        mrc_lines += [
+            f"OUTPUT HITS {point['hits']}",
+            f"OUTPUT MISSES {point['misses']}",
+        ]
+    check_output(
+        f"2.2.{2 * i + 2}", f"{expected_file_path.name}-lru", lru_lines, mrc_lines
+    )
+
+
+# Sweeps
+# ======================================================================================
+# The expected files are named after the trace, and hold the CSV output of the sweep
+# below. The results must not depend on the number of jobs.
+print(f"{bcolors.BOLD}Checking sweeps with different numbers of jobs.{bcolors.ENDC}")
 
-        if fail:
-            continue
+SWEEP_SPEC = (
+    "LRU,PLRU_BIT,SRRIP,DRRIP,RAND:1024,4096:128:1,2,4:NULL,ADJACENT,SEQUENTIAL:1"
+)
+sweep_i = 1
+for expected_file_path in sorted(Path(expected_dir, "sweep").iterdir()):
+    infile = Path(inputs_dir, expected_file_path.name)
+    for jobs in ("1", "4"):
+        print(f"  Checking {infile} with {jobs} jobs...", end=" ")
+        output_lines = run_cachesim(
+            [
+                "sweep", "--csv", "-s", POLICY_SEED, "-j", jobs,
+                "-t", str(infile), SWEEP_SPEC,
+            ]
+        )
+        check_output(
+            f"2.3.{sweep_i}", f"{expected_file_path.name}-j{jobs}", output_lines,
+            read_expected(expected_file_path),
+        )
+        sweep_i += 1
 
-        test_results_add(test_number, test_name, "PASS", max_score, max_score=max_score)
-        print(f"{bcolors.BOLD}{bcolors.OKGREEN}PASS{bcolors.ENDC}")
+
+# Resuming from snapshots
+# ======================================================================================
+# Each of the replacement policy cases is run over the first part of its trace, saving a
+# snapshot, then resumed from the snapshot over the whole trace. The results must be
+# the same as those of a single run.
+print(f"{bcolors.BOLD}Checking resuming from snapshots.{bcolors.ENDC}")
+
+RESUME_AFTER = 50000
+with tempfile.TemporaryDirectory() as snapshot_dir:
+    for i, (expected_file_path, args, infile) in enumerate(policy_cases):
+        print(
+            f"  Checking {infile} resumed after {RESUME_AFTER} accesses with "
+            f"parameters {' '.join(args)}...",
+            end=" ",
+        )
+        snapshot = str(Path(snapshot_dir, expected_file_path.name))
+        with open(infile, "rb") as i_file:
+            trace_lines = i_file.read().split(b"\n")
+        # Feed a few more lines than needed, as the trace may have malformed lines.
+        run_cachesim(
+            ["-s", POLICY_SEED, "-c", snapshot, "-C", str(RESUME_AFTER), *args],
+            b"\n".join(trace_lines[: RESUME_AFTER + 100]),
+        )
+        output_lines = run_sim(["-r", snapshot], infile)
+        check_output(
+            f"2.4.{i + 1}", f"{expected_file_path.name}-resume", output_lines,
+            read_expected(expected_file_path),
+        )
 
 
 # Print out the test results and store to the test results JSON file.
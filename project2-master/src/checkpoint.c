@@ -0,0 +1,159 @@
+//
+// This file contains the implementations for the functions defined in
+// checkpoint.h.
+//
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct checkpoint {
+    FILE *file;
+    char *path;      // The final path of the snapshot
+    char *temp_path; // Where it is written until it is complete (NULL when reading)
+    int failed;
+};
+
+// Reading and writing
+// ============================================================================
+struct checkpoint *checkpoint_create(const char *path)
+{
+    size_t len = strlen(path);
+    char *temp_path = malloc(len + sizeof(".tmp"));
+    memcpy(temp_path, path, len);
+    memcpy(temp_path + len, ".tmp", sizeof(".tmp"));
+
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s for writing\n", temp_path);
+        free(temp_path);
+        return NULL;
+    }
+
+    struct checkpoint *checkpoint = calloc(1, sizeof(struct checkpoint));
+    checkpoint->file = file;
+    checkpoint->path = strdup(path);
+    checkpoint->temp_path = temp_path;
+    return checkpoint;
+}
+
+struct checkpoint *checkpoint_open(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return NULL;
+    }
+
+    struct checkpoint *checkpoint = calloc(1, sizeof(struct checkpoint));
+    checkpoint->file = file;
+    checkpoint->path = strdup(path);
+    return checkpoint;
+}
+
+int checkpoint_write(struct checkpoint *checkpoint, const void *data, size_t size)
+{
+    if (!checkpoint->failed && size > 0 && fwrite(data, size, 1, checkpoint->file) != 1) {
+        checkpoint->failed = 1;
+    }
+    return checkpoint->failed;
+}
+
+int checkpoint_read(struct checkpoint *checkpoint, void *data, size_t size)
+{
+    if (!checkpoint->failed && size > 0 && fread(data, size, 1, checkpoint->file) != 1) {
+        checkpoint->failed = 1;
+    }
+    return checkpoint->failed;
+}
+
+int checkpoint_status(const struct checkpoint *checkpoint)
+{
+    return checkpoint->failed;
+}
+
+int checkpoint_close(struct checkpoint *checkpoint)
+{
+    int status = checkpoint->failed;
+    if (checkpoint->temp_path != NULL) {
+        status |= fclose(checkpoint->file) != 0;
+        if (status == 0 && rename(checkpoint->temp_path, checkpoint->path) != 0) status = 1;
+        if (status != 0) {
+            fprintf(stderr, "Failed to write the snapshot %s\n", checkpoint->path);
+            remove(checkpoint->temp_path);
+        }
+    } else {
+        // Anything left over means the snapshot does not match the cache
+        // system it was loaded into.
+        if (status == 0 && fgetc(checkpoint->file) != EOF) status = 1;
+        fclose(checkpoint->file);
+        if (status != 0) fprintf(stderr, "The snapshot %s is corrupt\n", checkpoint->path);
+    }
+
+    free(checkpoint->path);
+    free(checkpoint->temp_path);
+    free(checkpoint);
+    return status;
+}
+
+// Snapshots
+// ============================================================================
+int checkpoint_save(const char *path, const struct cache_config *config, uint64_t offset,
+                    struct cache_system *cache_system)
+{
+    struct checkpoint *checkpoint = checkpoint_create(path);
+    if (checkpoint == NULL) return 1;
+
+    struct checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    header.version = CHECKPOINT_VERSION;
+    header.offset = offset;
+    header.config = *config;
+    checkpoint_write(checkpoint, &header, sizeof(header));
+    cache_system_save(cache_system, checkpoint);
+    return checkpoint_close(checkpoint);
+}
+
+struct cache_system *checkpoint_restore(const char *path, struct cache_config *config,
+                                        uint64_t *offset)
+{
+    struct checkpoint *checkpoint = checkpoint_open(path);
+    if (checkpoint == NULL) return NULL;
+
+    struct checkpoint_header header;
+    if (checkpoint_read(checkpoint, &header, sizeof(header)) ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "%s is not a snapshot\n", path);
+        checkpoint_close(checkpoint);
+        return NULL;
+    }
+    if (header.version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header.version);
+        checkpoint_close(checkpoint);
+        return NULL;
+    }
+
+    // Make sure the names are terminated before using them.
+    header.config.replacement_policy[CONFIG_NAME_SIZE - 1] = '\0';
+    header.config.prefetcher[CONFIG_NAME_SIZE - 1] = '\0';
+    struct cache_system *cache_system = cache_system_from_config(&header.config);
+    if (cache_system == NULL) {
+        checkpoint_close(checkpoint);
+        return NULL;
+    }
+
+    int status = cache_system_load(cache_system, checkpoint);
+    if (status != 0 && checkpoint_status(checkpoint) == 0) {
+        fprintf(stderr, "The snapshot %s does not match its configuration\n", path);
+    }
+    if (checkpoint_close(checkpoint) != 0 || status != 0) {
+        cache_system_destroy(cache_system);
+        return NULL;
+    }
+    *config = header.config;
+    *offset = header.offset;
+    return cache_system;
+}
@@ -0,0 +1,74 @@
+//
+// This file defines snapshots of a cache system, which let a long simulation
+// be stopped and resumed, or a warmed-up cache be reused for several runs.
+//
+// A snapshot holds the configuration of the cache system, the number of trace
+// records simulated so far, and the whole simulation state: the statistics,
+// the cache lines, the set of accessed lines, the prefetch filter and shadow
+// cache if they are enabled, and the state of the replacement policy and the
+// prefetcher (through their save and load hooks). Restoring a snapshot and
+// simulating the rest of the trace gives exactly the same results as an
+// uninterrupted run.
+//
+// The file is a header followed by the raw state, in the byte order of the
+// machine that wrote it. Arrays are written as they are, and sets as the list
+// of their members, so a snapshot is about as large as the state itself.
+//
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define CHECKPOINT_MAGIC "CSSNAP01"
+#define CHECKPOINT_MAGIC_SIZE 8
+#define CHECKPOINT_VERSION 4
+
+// The header at the start of every snapshot.
+struct checkpoint_header {
+    char magic[CHECKPOINT_MAGIC_SIZE]; // Always CHECKPOINT_MAGIC (not NUL terminated)
+    uint32_t version;                  // CHECKPOINT_VERSION
+    uint32_t reserved;
+    uint64_t offset; // The number of trace records simulated before the snapshot
+    struct cache_config config;
+};
+
+// A snapshot being written or read. Errors are sticky: once a read or write
+// fails, every later one fails too, and so does checkpoint_close.
+struct checkpoint;
+
+// Start writing a snapshot to the given path. The snapshot is written to a
+// temporary file that only replaces the path once it is complete, so an
+// earlier snapshot survives a crash while the new one is being written.
+// Returns NULL and prints an error on failure.
+struct checkpoint *checkpoint_create(const char *path);
+
+// Open a snapshot for reading. Returns NULL and prints an error on failure.
+struct checkpoint *checkpoint_open(const char *path);
+
+// Write or read size bytes. Return 0 on success.
+int checkpoint_write(struct checkpoint *checkpoint, const void *data, size_t size);
+int checkpoint_read(struct checkpoint *checkpoint, void *data, size_t size);
+
+// Returns non-zero if any read or write has failed.
+int checkpoint_status(const struct checkpoint *checkpoint);
+
+// Finish the snapshot and free the checkpoint. When reading, the whole file
+// must have been read. Returns 0 on success, and prints an error otherwise.
+int checkpoint_close(struct checkpoint *checkpoint);
+
+// Save the cache system (created from the given config) and the trace offset
+// to a snapshot at path. Returns 0 on success.
+int checkpoint_save(const char *path, const struct cache_config *config, uint64_t offset,
+                    struct cache_system *cache_system);
+
+// Recreate the cache system saved at path, filling in its config and trace
+// offset. Returns NULL and prints an error on failure. The cache system should
+// be freed with cache_system_destroy.
+struct cache_system *checkpoint_restore(const char *path, struct cache_config *config,
+                                        uint64_t *offset);
+
+#endif
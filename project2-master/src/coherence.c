@@ -0,0 +1,284 @@
+//
+// This file contains the implementation of the multi-core simulation defined
+// in coherence.h.
+//
+
+#include "coherence.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CORE_INVALIDATED_INITIAL_CAPACITY 256
+
+static const struct option coherence_long_options[] = {
+    {"trace", required_argument, NULL, 't'},
+    {"seed", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0},
+};
+
+// Snooping bus
+// ============================================================================
+// Broadcast a transaction for the line to every other core. Copies are made
+// SHARED, or invalidated if invalidate is set, and MODIFIED copies are written
+// back. Sets *shared if another cache had the line and *supplied if one had it
+// MODIFIED (and so supplied the data instead of memory).
+static void coherence_snoop(struct coherence *coherence, struct coherence_core *requester,
+                            uint64_t address, bool invalidate, bool *shared, bool *supplied)
+{
+    *shared = *supplied = false;
+    for (uint32_t i = 0; i < coherence->num_cores; i++) {
+        struct coherence_core *core = coherence->cores[i];
+        if (core == NULL || core == requester) continue;
+
+        struct cache_system *cache_system = core->cache_system;
+        enum cache_status status = cache_system_line_status(cache_system, address);
+        if (status == INVALID) continue;
+
+        *shared = true;
+        if (status == MODIFIED) {
+            *supplied = true;
+            coherence->stats.bus_writebacks++;
+            coherence->stats.memory_writes++;
+        }
+
+        if (invalidate) {
+            cache_system_invalidate(cache_system, address, NULL);
+            core->invalidations++;
+            line_set_insert(&core->invalidated, address >> cache_system->offset_bits);
+        } else if (status != SHARED) {
+            cache_system_set_line_status(cache_system, address, SHARED);
+        }
+    }
+    if (*supplied) coherence->stats.cache_to_cache++;
+}
+
+// Listener
+// ============================================================================
+static int coherence_fill(struct cache_system_listener *listener,
+                          struct cache_system *cache_system, uint64_t address, bool is_prefetch,
+                          uint8_t *status)
+{
+    struct coherence_core *core = listener->data;
+    struct coherence *coherence = core->coherence;
+
+    // A demand miss on a line that another core took away. The cache system
+    // counts it as a conflict miss since the line was accessed before.
+    uint64_t line_id = address >> cache_system->offset_bits;
+    if (line_set_remove(&core->invalidated, line_id) && !is_prefetch &&
+        line_set_contains(&cache_system->accessed_lines, line_id)) {
+        core->coherence_misses++;
+    }
+
+    bool is_write = *status == MODIFIED;
+    if (is_write) {
+        coherence->stats.bus_read_exclusives++;
+    } else {
+        coherence->stats.bus_reads++;
+    }
+
+    bool shared, supplied;
+    coherence_snoop(coherence, core, address, is_write, &shared, &supplied);
+    if (!supplied) coherence->stats.memory_reads++;
+    if (!is_write && shared) *status = SHARED;
+    return 0;
+}
+
+static int coherence_evict(struct cache_system_listener *listener,
+                           struct cache_system *cache_system, uint64_t address, bool dirty)
+{
+    struct coherence_core *core = listener->data;
+    if (dirty) {
+        core->coherence->stats.bus_writebacks++;
+        core->coherence->stats.memory_writes++;
+    }
+    return 0;
+}
+
+static int coherence_upgrade(struct cache_system_listener *listener,
+                             struct cache_system *cache_system, uint64_t address)
+{
+    struct coherence_core *core = listener->data;
+    bool shared, supplied;
+    core->coherence->stats.bus_upgrades++;
+    coherence_snoop(core->coherence, core, address, true, &shared, &supplied);
+    return 0;
+}
+
+// Cores
+// ============================================================================
+static struct coherence_core *coherence_core_get(struct coherence *coherence, uint32_t core_id)
+{
+    if (coherence->cores[core_id] != NULL) return coherence->cores[core_id];
+
+    struct cache_config config = coherence->config;
+    config.seed += core_id;
+    struct cache_system *cache_system = cache_system_from_config(&config);
+    if (cache_system == NULL) return NULL;
+
+    struct coherence_core *core = calloc(1, sizeof(struct coherence_core));
+    core->coherence = coherence;
+    core->core = core_id;
+    core->cache_system = cache_system;
+    line_set_init(&core->invalidated, CORE_INVALIDATED_INITIAL_CAPACITY);
+
+    core->listener.fill = &coherence_fill;
+    core->listener.evict = &coherence_evict;
+    core->listener.upgrade = &coherence_upgrade;
+    core->listener.data = core;
+    cache_system->listener = &core->listener;
+
+    coherence->cores[core_id] = core;
+    if (core_id >= coherence->num_cores) coherence->num_cores = core_id + 1;
+    return core;
+}
+
+struct coherence *coherence_new(const struct cache_config *config)
+{
+    struct coherence *coherence = calloc(1, sizeof(struct coherence));
+    coherence->config = *config;
+
+    // Create core 0 up front to check the config.
+    if (coherence_core_get(coherence, 0) == NULL) {
+        free(coherence);
+        return NULL;
+    }
+    return coherence;
+}
+
+void coherence_cleanup(struct coherence *coherence)
+{
+    for (uint32_t i = 0; i < coherence->num_cores; i++) {
+        struct coherence_core *core = coherence->cores[i];
+        if (core == NULL) continue;
+        cache_system_destroy(core->cache_system);
+        line_set_cleanup(&core->invalidated);
+        free(core);
+    }
+}
+
+int coherence_mem_access(struct coherence *coherence, uint32_t core_id, uint64_t address, char rw)
+{
+    if (core_id >= COHERENCE_MAX_CORES) {
+        fprintf(stderr, "Core ID %u is out of range\n", core_id);
+        return 1;
+    }
+    struct coherence_core *core = coherence_core_get(coherence, core_id);
+    if (core == NULL) return 1;
+    return cache_system_mem_access(core->cache_system, address, rw, false);
+}
+
+// multicore subcommand
+// ============================================================================
+static void coherence_print(struct coherence *coherence)
+{
+    printf("Multi-Core Statistics (MESI)\n");
+    printf("============================\n");
+
+    struct cache_system_stats total;
+    memset(&total, 0, sizeof(total));
+    uint64_t total_coherence_misses = 0, total_invalidations = 0;
+    for (uint32_t i = 0; i < coherence->num_cores; i++) {
+        struct coherence_core *core = coherence->cores[i];
+        if (core == NULL) continue;
+
+        struct cache_system_stats *stats = &core->cache_system->stats;
+        printf("OUTPUT CORE %u ACCESSES %llu\n", i, (unsigned long long)stats->accesses);
+        printf("OUTPUT CORE %u HITS %llu\n", i, (unsigned long long)stats->hits);
+        printf("OUTPUT CORE %u MISSES %llu\n", i, (unsigned long long)stats->misses);
+        printf("OUTPUT CORE %u COMPULSORY MISSES %llu\n", i,
+               (unsigned long long)stats->compulsory_misses);
+        printf("OUTPUT CORE %u CONFLICT MISSES %llu\n", i,
+               (unsigned long long)(stats->conflict_misses - core->coherence_misses));
+        printf("OUTPUT CORE %u COHERENCE MISSES %llu\n", i,
+               (unsigned long long)core->coherence_misses);
+        printf("OUTPUT CORE %u INVALIDATIONS %llu\n", i, (unsigned long long)core->invalidations);
+        printf("OUTPUT CORE %u DIRTY EVICTIONS %llu\n", i,
+               (unsigned long long)stats->dirty_evictions);
+        printf("OUTPUT CORE %u HIT RATIO %.8f\n", i,
+               stats->accesses ? (double)stats->hits / stats->accesses : 0.0);
+
+        total.accesses += stats->accesses;
+        total.hits += stats->hits;
+        total.misses += stats->misses;
+        total_coherence_misses += core->coherence_misses;
+        total_invalidations += core->invalidations;
+    }
+
+    struct coherence_stats *bus = &coherence->stats;
+    printf("OUTPUT ACCESSES %llu\n", (unsigned long long)total.accesses);
+    printf("OUTPUT HITS %llu\n", (unsigned long long)total.hits);
+    printf("OUTPUT MISSES %llu\n", (unsigned long long)total.misses);
+    printf("OUTPUT COHERENCE MISSES %llu\n", (unsigned long long)total_coherence_misses);
+    printf("OUTPUT INVALIDATIONS %llu\n", (unsigned long long)total_invalidations);
+    printf("OUTPUT HIT RATIO %.8f\n", total.accesses ? (double)total.hits / total.accesses : 0.0);
+    printf("OUTPUT BUS READS %llu\n", (unsigned long long)bus->bus_reads);
+    printf("OUTPUT BUS READ EXCLUSIVES %llu\n", (unsigned long long)bus->bus_read_exclusives);
+    printf("OUTPUT BUS UPGRADES %llu\n", (unsigned long long)bus->bus_upgrades);
+    printf("OUTPUT BUS WRITEBACKS %llu\n", (unsigned long long)bus->bus_writebacks);
+    printf("OUTPUT BUS TRANSACTIONS %llu\n",
+           (unsigned long long)(bus->bus_reads + bus->bus_read_exclusives + bus->bus_upgrades +
+                                bus->bus_writebacks));
+    printf("OUTPUT CACHE TO CACHE TRANSFERS %llu\n", (unsigned long long)bus->cache_to_cache);
+    printf("OUTPUT MEMORY READS %llu\n", (unsigned long long)bus->memory_reads);
+    printf("OUTPUT MEMORY WRITES %llu\n", (unsigned long long)bus->memory_writes);
+}
+
+int coherence_main(int argc, char **argv)
+{
+    char *trace_path = NULL;
+    uint64_t seed = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:s:", coherence_long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: cachesim multicore [options] "
+                        "POLICY:SIZE:LINES:ASSOCIATIVITY:PREFETCHER:AMOUNT\n");
+        return 1;
+    }
+
+    struct cache_config config;
+    memset(&config, 0, sizeof(config));
+    if (!cache_config_parse(argv[optind], &config)) return 1;
+    config.prefetch_distance = CONFIG_DEFAULT_PREFETCH_DISTANCE;
+    config.seed = seed;
+
+    // Printing every access of every core would be unreadable.
+    verbosity = VERBOSITY_SILENT;
+
+    struct coherence *coherence = coherence_new(&config);
+    if (coherence == NULL) return 1;
+
+    struct trace_reader *trace = trace_reader_open(trace_path);
+    if (trace == NULL) return 1;
+
+    const struct trace_record *records;
+    size_t count;
+    while ((count = trace_reader_next(trace, &records)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (coherence_mem_access(coherence, trace_record_core(records[i]),
+                                     trace_record_address(records[i]),
+                                     trace_record_rw(records[i])) != 0) {
+                return 1;
+            }
+        }
+    }
+    if (trace_reader_close(trace) != 0) return 1;
+
+    coherence_print(coherence);
+    coherence_cleanup(coherence);
+    free(coherence);
+    return 0;
+}
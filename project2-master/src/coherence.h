@@ -0,0 +1,91 @@
+//
+// This file defines the multi-core simulation, in which every core has a
+// private cache and the caches are kept coherent with the MESI protocol over a
+// snooping bus.
+//
+// The trace carries the core ID of every access (see trace.h). Each core's
+// cache is a cache system built from the same config, created the first time
+// the core appears in the trace. A miss is broadcast on the bus:
+//  * A read miss (BusRd) makes every other copy SHARED. A MODIFIED copy is
+//    written back to memory and supplies the data. The new line is SHARED if
+//    another cache had it, and EXCLUSIVE otherwise.
+//  * A write miss (BusRdX) invalidates every other copy, writing back a
+//    MODIFIED one. The new line is MODIFIED.
+//  * A write hit on a SHARED line (BusUpgr) invalidates every other copy.
+//    Write hits on EXCLUSIVE lines become MODIFIED without a bus transaction.
+// Evicting a MODIFIED line writes it back to memory (BusWB).
+//
+// A coherence miss is a demand miss on a line that was invalidated by another
+// core's write since this core last had it. These are counted separately from
+// the compulsory and conflict misses. Coherence misses on lines that the cores
+// write to different parts of are the signature of false sharing.
+//
+// The `cachesim multicore` subcommand runs the simulation:
+//
+//      cachesim multicore [options] POLICY:SIZE:LINES:ASSOCIATIVITY:PREFETCHER:AMOUNT
+//
+// Options:
+//      -t, --trace FILE      read the trace from FILE instead of stdin
+//      -s, --seed N          seed for random replacement decisions. Core i
+//                            uses N + i (default: 0)
+//
+
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "line_set.h"
+#include "memory_system.h"
+#include "trace.h"
+
+#define COHERENCE_MAX_CORES TRACE_MAX_CORES
+
+struct coherence;
+
+// One core and its private cache. Its cache system's listener points back
+// here.
+struct coherence_core {
+    struct coherence *coherence;
+    uint32_t core;
+    struct cache_system *cache_system;
+    struct cache_system_listener listener;
+
+    // The lines that another core's write invalidated in this cache and that
+    // this core has not fetched again since.
+    struct line_set invalidated;
+
+    uint64_t coherence_misses;
+    uint64_t invalidations; // Lines of this cache invalidated by other cores
+};
+
+struct coherence_stats {
+    uint64_t bus_reads;            // BusRd
+    uint64_t bus_read_exclusives;  // BusRdX
+    uint64_t bus_upgrades;         // BusUpgr
+    uint64_t bus_writebacks;       // BusWB, including MODIFIED copies flushed by a snoop
+    uint64_t cache_to_cache;       // Misses supplied by another cache's MODIFIED copy
+    uint64_t memory_reads, memory_writes;
+};
+
+struct coherence {
+    struct cache_config config;
+    uint32_t num_cores; // One more than the highest core ID seen
+    struct coherence_core *cores[COHERENCE_MAX_CORES];
+    struct coherence_stats stats;
+};
+
+// Create a multi-core simulation in which every core has a cache built from
+// the given config. Returns NULL and prints an error if the config is invalid.
+struct coherence *coherence_new(const struct cache_config *config);
+void coherence_cleanup(struct coherence *coherence);
+
+// Send an access from the given core to its cache. Returns non-zero on error.
+int coherence_mem_access(struct coherence *coherence, uint32_t core, uint64_t address, char rw);
+
+// The entrypoint for `cachesim multicore`. argv[0] is "multicore".
+int coherence_main(int argc, char **argv);
+
+#endif
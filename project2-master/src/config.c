@@ -0,0 +1,139 @@
+//
+// This file contains the implementations for the functions defined in
+// config.h.
+//
+
+#include "config.h"
+
+#include <string.h>
+
+static bool is_power_of_two(uint32_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static bool parse_field_uint32(const char *str, uint32_t *out)
+{
+    char *endptr;
+    unsigned long value = strtoul(str, &endptr, 10);
+    if (*str == '\0' || *endptr != '\0' || value > UINT32_MAX) return false;
+    *out = value;
+    return true;
+}
+
+bool cache_config_parse(const char *spec, struct cache_config *config)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+
+    char *fields[7];
+    int num_fields = 0;
+    char *saveptr;
+    for (char *field = strtok_r(buffer, ":", &saveptr); field != NULL && num_fields < 7;
+         field = strtok_r(NULL, ":", &saveptr)) {
+        fields[num_fields++] = field;
+    }
+    if (num_fields != 6 || !parse_field_uint32(fields[1], &config->cache_size) ||
+        !parse_field_uint32(fields[2], &config->cache_lines) ||
+        !parse_field_uint32(fields[3], &config->associativity) ||
+        !parse_field_uint32(fields[5], &config->prefetch_amount)) {
+        fprintf(stderr, "Invalid cache spec %s\n", spec);
+        return false;
+    }
+    snprintf(config->replacement_policy, CONFIG_NAME_SIZE, "%s", fields[0]);
+    snprintf(config->prefetcher, CONFIG_NAME_SIZE, "%s", fields[4]);
+    return true;
+}
+
+bool cache_config_validate(const struct cache_config *config)
+{
+    if (config->cache_lines == 0 || config->associativity == 0 ||
+        config->cache_size % config->cache_lines != 0 ||
+        config->cache_lines % config->associativity != 0) {
+        fprintf(stderr, "Invalid geometry: %u bytes, %u lines, %u-way\n", config->cache_size,
+                config->cache_lines, config->associativity);
+        return false;
+    }
+    if (!is_power_of_two(cache_config_line_size(config)) ||
+        !is_power_of_two(cache_config_sets(config))) {
+        fprintf(stderr, "Invalid geometry: line size %u and set count %u must be powers of two\n",
+                cache_config_line_size(config), cache_config_sets(config));
+        return false;
+    }
+    return true;
+}
+
+struct replacement_policy *replacement_policy_new_by_name(const char *name, uint32_t sets,
+                                                          uint32_t associativity, uint64_t seed)
+{
+    if (!strcmp("LRU", name)) {
+        return lru_replacement_policy_new(sets, associativity);
+    } else if (!strcmp("RAND", name)) {
+        return rand_replacement_policy_new(sets, associativity, seed);
+    } else if (!strcmp("LRU_PREFER_CLEAN", name)) {
+        return lru_prefer_clean_replacement_policy_new(sets, associativity);
+    } else if (!strcmp("PLRU_TREE", name)) {
+        return plru_tree_replacement_policy_new(sets, associativity);
+    } else if (!strcmp("PLRU_BIT", name)) {
+        return plru_bit_replacement_policy_new(sets, associativity);
+    } else if (!strcmp("SRRIP", name)) {
+        return srrip_replacement_policy_new(sets, associativity);
+    } else if (!strcmp("BRRIP", name)) {
+        return brrip_replacement_policy_new(sets, associativity, seed);
+    } else if (!strcmp("DRRIP", name)) {
+        return drrip_replacement_policy_new(sets, associativity, seed);
+    }
+    fprintf(stderr, "Unknown replacement policy %s\n", name);
+    return NULL;
+}
+
+struct prefetcher *prefetcher_new_by_name(const char *name, uint32_t prefetch_amount,
+                                          uint32_t prefetch_distance)
+{
+    if (!strcmp("NULL", name)) {
+        return null_prefetcher_new();
+    } else if (!strcmp("ADJACENT", name)) {
+        return adjacent_prefetcher_new();
+    } else if (!strcmp("SEQUENTIAL", name)) {
+        return sequential_prefetcher_new(prefetch_amount);
+    } else if (!strcmp("CUSTOM", name)) {
+        return custom_prefetcher_new(prefetch_amount, prefetch_distance);
+    }
+    fprintf(stderr, "Unknown prefetcher %s\n", name);
+    return NULL;
+}
+
+struct cache_system *cache_system_from_config(const struct cache_config *config)
+{
+    if (!cache_config_validate(config)) return NULL;
+
+    struct cache_system *cache_system = cache_system_new(
+        cache_config_line_size(config), cache_config_sets(config), config->associativity);
+
+    struct replacement_policy *replacement_policy = replacement_policy_new_by_name(
+        config->replacement_policy, cache_system->num_sets, cache_system->associativity,
+        config->seed);
+    if (replacement_policy != NULL) {
+        cache_system_set_replacement_policy(cache_system, replacement_policy);
+    }
+    cache_system->prefetcher = prefetcher_new_by_name(config->prefetcher, config->prefetch_amount,
+                                                       config->prefetch_distance);
+    if (cache_system->replacement_policy == NULL || cache_system->prefetcher == NULL) {
+        cache_system_destroy(cache_system);
+        return NULL;
+    }
+    if (config->prefetch_filter) cache_system_enable_prefetch_filter(cache_system);
+    return cache_system;
+}
+
+void cache_system_destroy(struct cache_system *cache_system)
+{
+    struct prefetcher *prefetcher = cache_system->prefetcher;
+    cache_system_cleanup(cache_system);
+    free(cache_system);
+
+    if (prefetcher != NULL) {
+        prefetcher->cleanup(prefetcher);
+        free(prefetcher);
+    }
+}
@@ -0,0 +1,65 @@
+//
+// This file defines the cache_config struct, which describes one cache system
+// (its geometry, replacement policy and prefetcher), and the functions for
+// building cache systems, replacement policies and prefetchers by name.
+//
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory_system.h"
+
+#define CONFIG_NAME_SIZE 32
+#define CONFIG_DEFAULT_PREFETCH_DISTANCE 1
+
+// A full description of a cache system, as given on the cachesim command line.
+struct cache_config {
+    char replacement_policy[CONFIG_NAME_SIZE];
+    uint32_t cache_size;
+    uint32_t cache_lines;
+    uint32_t associativity;
+    char prefetcher[CONFIG_NAME_SIZE];
+    uint32_t prefetch_amount;
+    uint32_t prefetch_distance; // How far ahead of a stream CUSTOM prefetches
+    bool prefetch_filter;       // Queue and filter the prefetches
+    uint64_t seed; // Seed for the random choices of the replacement policy
+};
+
+// Parse a POLICY:SIZE:LINES:ASSOCIATIVITY:PREFETCHER:AMOUNT spec into the
+// corresponding fields of config, leaving the other fields alone. If the spec
+// is malformed, print why to stderr and return false.
+bool cache_config_parse(const char *spec, struct cache_config *config);
+
+// Check that the geometry of the config is valid (the line size and number of
+// sets are powers of two, etc.). If not, print why to stderr and return false.
+bool cache_config_validate(const struct cache_config *config);
+
+static inline uint32_t cache_config_line_size(const struct cache_config *config)
+{
+    return config->cache_size / config->cache_lines;
+}
+
+static inline uint32_t cache_config_sets(const struct cache_config *config)
+{
+    return config->cache_lines / config->associativity;
+}
+
+// Create a replacement policy or prefetcher from its command line name.
+// Returns NULL and prints an error if the name is unknown.
+struct replacement_policy *replacement_policy_new_by_name(const char *name, uint32_t sets,
+                                                          uint32_t associativity, uint64_t seed);
+struct prefetcher *prefetcher_new_by_name(const char *name, uint32_t prefetch_amount,
+                                          uint32_t prefetch_distance);
+
+// Create a cache system, including its replacement policy and prefetcher, from
+// a config. Returns NULL and prints an error if the config is invalid.
+struct cache_system *cache_system_from_config(const struct cache_config *config);
+
+// Clean up and free a cache system created by cache_system_from_config,
+// including its replacement policy and prefetcher.
+void cache_system_destroy(struct cache_system *cache_system);
+
+#endif
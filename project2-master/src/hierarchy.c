@@ -0,0 +1,298 @@
+//
+// This file contains the implementation of the cache hierarchy defined in
+// hierarchy.h.
+//
+
+#include "hierarchy.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static const char *inclusion_policy_names[] = {
+    [INCLUSION_INCLUSIVE] = "inclusive",
+    [INCLUSION_EXCLUSIVE] = "exclusive",
+    [INCLUSION_NINE] = "nine",
+};
+
+static const struct option hierarchy_long_options[] = {
+    {"trace", required_argument, NULL, 't'},
+    {"inclusion", required_argument, NULL, 'i'},
+    {"seed", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0},
+};
+
+bool inclusion_policy_parse(const char *name, enum inclusion_policy *inclusion)
+{
+    for (int i = 0; i < sizeof(inclusion_policy_names) / sizeof(*inclusion_policy_names); i++) {
+        if (!strcmp(name, inclusion_policy_names[i])) {
+            *inclusion = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Exclusive lookups
+// ============================================================================
+// In an exclusive hierarchy, a lookup in a lower level removes the line from
+// that level (it moves up to the first level) or, on a miss, continues to the
+// next level. The line is never stored on the way up, so this goes around
+// cache_system_mem_access and keeps the level's statistics itself.
+static int hierarchy_exclusive_fetch(struct hierarchy *hierarchy, struct hierarchy_level *level,
+                                     uint64_t address, bool is_prefetch, bool *dirty)
+{
+    struct cache_system *cache_system = level->cache_system;
+    if (!is_prefetch) cache_system->stats.accesses++;
+
+    int status = 0;
+    bool hit = cache_system_invalidate(cache_system, address, dirty);
+    if (hit) {
+        if (!is_prefetch) cache_system->stats.hits++;
+    } else {
+        if (!is_prefetch) {
+            cache_system->stats.misses++;
+            if (line_set_insert(&cache_system->accessed_lines,
+                                address >> cache_system->offset_bits)) {
+                cache_system->stats.compulsory_misses++;
+            } else {
+                cache_system->stats.conflict_misses++;
+            }
+        }
+
+        if (level->level + 1 == hierarchy->num_levels) {
+            hierarchy->memory_reads++;
+        } else {
+            status = hierarchy_exclusive_fetch(hierarchy, &hierarchy->levels[level->level + 1],
+                                               address, is_prefetch, dirty);
+        }
+    }
+
+    if (!is_prefetch && status == 0) {
+        cache_system->stats.prefetches += (*cache_system->prefetcher->handle_mem_access)(
+            cache_system->prefetcher, cache_system, address, !hit);
+    }
+    return status;
+}
+
+// Listener
+// ============================================================================
+static int hierarchy_fill(struct cache_system_listener *listener,
+                          struct cache_system *cache_system, uint64_t address, bool is_prefetch,
+                          uint8_t *status)
+{
+    struct hierarchy_level *level = listener->data;
+    struct hierarchy *hierarchy = level->hierarchy;
+
+    // A line can only be in one level of an exclusive hierarchy, so a lower
+    // level must not prefetch a line that a level above already has.
+    if (hierarchy->inclusion == INCLUSION_EXCLUSIVE && is_prefetch) {
+        for (uint32_t i = 0; i < level->level; i++) {
+            if (cache_system_probe(hierarchy->levels[i].cache_system, address)) {
+                return CACHE_SYSTEM_FILL_DROPPED;
+            }
+        }
+    }
+
+    if (level->level + 1 == hierarchy->num_levels) {
+        hierarchy->memory_reads++;
+        return 0;
+    }
+
+    struct hierarchy_level *below = &hierarchy->levels[level->level + 1];
+    if (hierarchy->inclusion == INCLUSION_EXCLUSIVE) {
+        bool dirty = false;
+        int result = hierarchy_exclusive_fetch(hierarchy, below, address, is_prefetch, &dirty);
+        if (dirty) *status = MODIFIED;
+        return result;
+    }
+
+    // The line is stored in the level below too. It stays dirty there (if it
+    // is), and arrives clean here.
+    return cache_system_mem_access(below->cache_system, address, 'R', is_prefetch);
+}
+
+static int hierarchy_evict(struct cache_system_listener *listener,
+                           struct cache_system *cache_system, uint64_t address, bool dirty)
+{
+    struct hierarchy_level *level = listener->data;
+    struct hierarchy *hierarchy = level->hierarchy;
+
+    // Keep the levels above a subset of this one. Their copies may be newer.
+    if (hierarchy->inclusion == INCLUSION_INCLUSIVE) {
+        for (uint32_t i = 0; i < level->level; i++) {
+            bool upper_dirty = false;
+            if (cache_system_invalidate(hierarchy->levels[i].cache_system, address,
+                                        &upper_dirty)) {
+                level->back_invalidations++;
+                dirty |= upper_dirty;
+            }
+        }
+    }
+
+    // Clean lines are only passed down in an exclusive hierarchy, where this
+    // level held the only copy.
+    if (!dirty && hierarchy->inclusion != INCLUSION_EXCLUSIVE) return 0;
+
+    if (level->level + 1 == hierarchy->num_levels) {
+        if (dirty) hierarchy->memory_writes++;
+        return 0;
+    }
+
+    struct hierarchy_level *below = &hierarchy->levels[level->level + 1];
+    if (dirty) below->writebacks++;
+    return cache_system_install(below->cache_system, address, dirty);
+}
+
+// Hierarchy
+// ============================================================================
+struct hierarchy *hierarchy_new(const struct cache_config *configs, uint32_t num_levels,
+                                enum inclusion_policy inclusion)
+{
+    if (num_levels == 0 || num_levels > HIERARCHY_MAX_LEVELS) {
+        fprintf(stderr, "A hierarchy needs between 1 and %d levels\n", HIERARCHY_MAX_LEVELS);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < num_levels; i++) {
+        if (!cache_config_validate(&configs[i])) return NULL;
+        if (cache_config_line_size(&configs[i]) != cache_config_line_size(&configs[0])) {
+            fprintf(stderr, "Every level of a hierarchy must have the same line size\n");
+            return NULL;
+        }
+    }
+
+    struct hierarchy *hierarchy = calloc(1, sizeof(struct hierarchy));
+    hierarchy->inclusion = inclusion;
+    for (uint32_t i = 0; i < num_levels; i++) {
+        struct hierarchy_level *level = &hierarchy->levels[i];
+        level->hierarchy = hierarchy;
+        level->level = i;
+        level->cache_system = cache_system_from_config(&configs[i]);
+        if (level->cache_system == NULL) {
+            hierarchy_cleanup(hierarchy);
+            free(hierarchy);
+            return NULL;
+        }
+        hierarchy->num_levels++;
+
+        level->listener.fill = &hierarchy_fill;
+        level->listener.evict = &hierarchy_evict;
+        level->listener.data = level;
+        level->cache_system->listener = &level->listener;
+    }
+    return hierarchy;
+}
+
+void hierarchy_cleanup(struct hierarchy *hierarchy)
+{
+    for (uint32_t i = 0; i < hierarchy->num_levels; i++) {
+        cache_system_destroy(hierarchy->levels[i].cache_system);
+    }
+}
+
+int hierarchy_mem_access(struct hierarchy *hierarchy, uint64_t address, char rw)
+{
+    return cache_system_mem_access(hierarchy->levels[0].cache_system, address, rw, false);
+}
+
+// hierarchy subcommand
+// ============================================================================
+static void hierarchy_print(struct hierarchy *hierarchy)
+{
+    printf("Cache Hierarchy (%s)\n", inclusion_policy_names[hierarchy->inclusion]);
+    printf("===============\n");
+    for (uint32_t i = 0; i < hierarchy->num_levels; i++) {
+        struct hierarchy_level *level = &hierarchy->levels[i];
+        struct cache_system_stats *stats = &level->cache_system->stats;
+        printf("OUTPUT L%u ACCESSES %llu\n", i + 1, (unsigned long long)stats->accesses);
+        printf("OUTPUT L%u HITS %llu\n", i + 1, (unsigned long long)stats->hits);
+        printf("OUTPUT L%u MISSES %llu\n", i + 1, (unsigned long long)stats->misses);
+        printf("OUTPUT L%u PREFETCHES %llu\n", i + 1, (unsigned long long)stats->prefetches);
+        printf("OUTPUT L%u COMPULSORY MISSES %llu\n", i + 1,
+               (unsigned long long)stats->compulsory_misses);
+        printf("OUTPUT L%u CONFLICT MISSES %llu\n", i + 1,
+               (unsigned long long)stats->conflict_misses);
+        printf("OUTPUT L%u DIRTY EVICTIONS %llu\n", i + 1,
+               (unsigned long long)stats->dirty_evictions);
+        printf("OUTPUT L%u WRITEBACKS %llu\n", i + 1, (unsigned long long)level->writebacks);
+        printf("OUTPUT L%u BACK INVALIDATIONS %llu\n", i + 1,
+               (unsigned long long)level->back_invalidations);
+        printf("OUTPUT L%u HIT RATIO %.8f\n", i + 1,
+               stats->accesses ? (double)stats->hits / stats->accesses : 0.0);
+    }
+
+    uint32_t line_size = hierarchy->levels[0].cache_system->line_size;
+    printf("OUTPUT MEMORY READS %llu\n", (unsigned long long)hierarchy->memory_reads);
+    printf("OUTPUT MEMORY WRITES %llu\n", (unsigned long long)hierarchy->memory_writes);
+    printf("OUTPUT MEMORY TRAFFIC BYTES %llu\n",
+           (unsigned long long)(hierarchy->memory_reads + hierarchy->memory_writes) * line_size);
+}
+
+int hierarchy_main(int argc, char **argv)
+{
+    char *trace_path = NULL;
+    enum inclusion_policy inclusion = INCLUSION_NINE;
+    uint64_t seed = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:i:s:", hierarchy_long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'i':
+            if (!inclusion_policy_parse(optarg, &inclusion)) {
+                fprintf(stderr, "Unknown inclusion policy %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    uint32_t num_levels = argc - optind;
+    if (num_levels == 0 || num_levels > HIERARCHY_MAX_LEVELS) {
+        fprintf(stderr, "Usage: cachesim hierarchy [options] LEVEL...\n");
+        return 1;
+    }
+    struct cache_config configs[HIERARCHY_MAX_LEVELS];
+    memset(configs, 0, sizeof(configs));
+    for (uint32_t i = 0; i < num_levels; i++) {
+        if (!cache_config_parse(argv[optind + i], &configs[i])) return 1;
+        configs[i].prefetch_distance = CONFIG_DEFAULT_PREFETCH_DISTANCE;
+        configs[i].seed = seed + i;
+    }
+
+    // Printing every access at every level would be unreadable.
+    verbosity = VERBOSITY_SILENT;
+
+    struct hierarchy *hierarchy = hierarchy_new(configs, num_levels, inclusion);
+    if (hierarchy == NULL) return 1;
+
+    struct trace_reader *trace = trace_reader_open(trace_path);
+    if (trace == NULL) return 1;
+
+    const struct trace_record *records;
+    size_t count;
+    while ((count = trace_reader_next(trace, &records)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (hierarchy_mem_access(hierarchy, trace_record_address(records[i]),
+                                     trace_record_rw(records[i])) != 0) {
+                return 1;
+            }
+        }
+    }
+    if (trace_reader_close(trace) != 0) return 1;
+
+    hierarchy_print(hierarchy);
+    hierarchy_cleanup(hierarchy);
+    free(hierarchy);
+    return 0;
+}
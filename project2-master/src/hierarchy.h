@@ -0,0 +1,89 @@
+//
+// This file defines the cache hierarchy, which chains several cache systems
+// (L1, L2, ..., the last level cache) in front of memory.
+//
+// The first level receives the trace. Misses at each level fetch the line
+// from the next level, and lines evicted from each level are written back to
+// the next level (or memory). Every level has its own replacement policy and
+// prefetcher. All levels must have the same line size.
+//
+// The inclusion policy decides which levels hold a line:
+//  * inclusive: every line in a level is also in all of the levels below it.
+//    Misses fill every level on the way up, and a line evicted from a level is
+//    invalidated in the levels above it (back-invalidation).
+//  * exclusive: a line is in at most one level. A hit in a lower level moves
+//    the line up to the first level, misses fill only the first level, and
+//    every line evicted from a level (clean or dirty) moves down one level.
+//  * nine (non-inclusive non-exclusive): misses fill every level on the way
+//    up, but evictions do not invalidate other levels. Only dirty lines are
+//    written back.
+//
+// The `cachesim hierarchy` subcommand simulates a hierarchy:
+//
+//      cachesim hierarchy [options] LEVEL...
+//
+// Each LEVEL is a POLICY:SIZE:LINES:ASSOCIATIVITY:PREFETCHER:AMOUNT spec, from
+// the first level to the last.
+//
+// Options:
+//      -t, --trace FILE      read the trace from FILE instead of stdin
+//      -i, --inclusion MODE  inclusive, exclusive or nine (default: nine)
+//      -s, --seed N          seed for random replacement decisions. Level i
+//                            uses N + i (default: 0)
+//
+
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "memory_system.h"
+
+#define HIERARCHY_MAX_LEVELS 8
+
+enum inclusion_policy {
+    INCLUSION_INCLUSIVE,
+    INCLUSION_EXCLUSIVE,
+    INCLUSION_NINE,
+};
+
+struct hierarchy;
+
+// One level of the hierarchy. Its cache system's listener points back here.
+struct hierarchy_level {
+    struct hierarchy *hierarchy;
+    uint32_t level; // 0 for L1
+    struct cache_system *cache_system;
+    struct cache_system_listener listener;
+
+    uint64_t writebacks;         // Dirty lines written back into this level from above
+    uint64_t back_invalidations; // Lines invalidated above because this level evicted them
+};
+
+struct hierarchy {
+    enum inclusion_policy inclusion;
+    uint32_t num_levels;
+    struct hierarchy_level levels[HIERARCHY_MAX_LEVELS];
+
+    // Memory traffic, in lines.
+    uint64_t memory_reads, memory_writes;
+};
+
+// Parse an inclusion policy name. Returns false if it is unknown.
+bool inclusion_policy_parse(const char *name, enum inclusion_policy *inclusion);
+
+// Create a hierarchy from the configs of its levels, first level first.
+// Returns NULL and prints an error if a config is invalid.
+struct hierarchy *hierarchy_new(const struct cache_config *configs, uint32_t num_levels,
+                                enum inclusion_policy inclusion);
+void hierarchy_cleanup(struct hierarchy *hierarchy);
+
+// Send a demand access to the first level. Returns non-zero on error.
+int hierarchy_mem_access(struct hierarchy *hierarchy, uint64_t address, char rw);
+
+// The entrypoint for `cachesim hierarchy`. argv[0] is "hierarchy".
+int hierarchy_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,93 @@
+//
+// This file contains the implementations for the functions defined in
+// intervals.h.
+//
+
+#include "intervals.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+// The columns of CSV logs, in the order of struct cache_system_stats.
+static const struct {
+    const char *name;
+    size_t offset;
+} interval_columns[] = {
+    {"accesses", offsetof(struct cache_system_stats, accesses)},
+    {"hits", offsetof(struct cache_system_stats, hits)},
+    {"misses", offsetof(struct cache_system_stats, misses)},
+    {"prefetches", offsetof(struct cache_system_stats, prefetches)},
+    {"compulsory_misses", offsetof(struct cache_system_stats, compulsory_misses)},
+    {"conflict_misses", offsetof(struct cache_system_stats, conflict_misses)},
+    {"capacity_misses", offsetof(struct cache_system_stats, capacity_misses)},
+    {"dirty_evictions", offsetof(struct cache_system_stats, dirty_evictions)},
+    {"prefetches_filtered", offsetof(struct cache_system_stats, prefetches_filtered)},
+    {"prefetches_filled", offsetof(struct cache_system_stats, prefetches_filled)},
+    {"useful_prefetches", offsetof(struct cache_system_stats, useful_prefetches)},
+    {"useless_prefetches", offsetof(struct cache_system_stats, useless_prefetches)},
+    {"pollution_evictions", offsetof(struct cache_system_stats, pollution_evictions)},
+    {"late_prefetches", offsetof(struct cache_system_stats, late_prefetches)},
+};
+
+#define INTERVAL_COLUMNS (sizeof(interval_columns) / sizeof(interval_columns[0]))
+
+static inline uint64_t *interval_stat(struct cache_system_stats *stats, size_t column)
+{
+    return (uint64_t *)((char *)stats + interval_columns[column].offset);
+}
+
+struct interval_sink *interval_sink_new(const char *path, enum event_sink_format format,
+                                        const struct cache_system_stats *stats)
+{
+    FILE *file = fopen(path, format == EVENT_SINK_BINARY ? "wb" : "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open interval log %s\n", path);
+        return NULL;
+    }
+
+    struct interval_sink *sink = calloc(1, sizeof(struct interval_sink));
+    sink->file = file;
+    sink->format = format;
+    sink->previous = *stats;
+
+    if (format == EVENT_SINK_CSV) {
+        fprintf(file, "end");
+        for (size_t i = 0; i < INTERVAL_COLUMNS; i++) fprintf(file, ",%s", interval_columns[i].name);
+        fprintf(file, "\n");
+    }
+    return sink;
+}
+
+void interval_sink_write(struct interval_sink *sink, uint64_t end,
+                         const struct cache_system_stats *stats)
+{
+    struct cache_interval interval = {end, *stats};
+    for (size_t i = 0; i < INTERVAL_COLUMNS; i++) {
+        *interval_stat(&interval.stats, i) -= *interval_stat(&sink->previous, i);
+    }
+    sink->previous = *stats;
+
+    if (sink->format == EVENT_SINK_BINARY) {
+        fwrite(&interval, sizeof(interval), 1, sink->file);
+    } else {
+        fprintf(sink->file, "%llu", (unsigned long long)end);
+        for (size_t i = 0; i < INTERVAL_COLUMNS; i++) {
+            fprintf(sink->file, ",%llu",
+                    (unsigned long long)*interval_stat(&interval.stats, i));
+        }
+        fprintf(sink->file, "\n");
+    }
+}
+
+void interval_sink_rebase(struct interval_sink *sink, const struct cache_system_stats *stats)
+{
+    sink->previous = *stats;
+}
+
+int interval_sink_close(struct interval_sink *sink)
+{
+    int status = ferror(sink->file) ? 1 : 0;
+    status |= fclose(sink->file) != 0;
+    free(sink);
+    return status;
+}
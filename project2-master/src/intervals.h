@@ -0,0 +1,50 @@
+//
+// This file defines the interval log, a time series of the cache statistics
+// that shows how the behaviour of a trace changes from phase to phase.
+//
+// The trace is split into intervals of a fixed number of demand accesses, and
+// each interval becomes one row holding how much each statistic grew during
+// it. In CSV logs the first line names the columns. Binary logs are a plain
+// array of struct cache_interval.
+//
+
+#ifndef INTERVALS_H
+#define INTERVALS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "logging.h"
+#include "memory_system.h"
+
+// One row of the log. This is also the record layout of binary logs.
+struct cache_interval {
+    uint64_t end; // The number of trace records simulated at the end of the interval
+    struct cache_system_stats stats; // What happened during the interval
+};
+
+struct interval_sink {
+    FILE *file;
+    enum event_sink_format format;
+    struct cache_system_stats previous; // The statistics at the start of the interval
+};
+
+// Open an interval log writing to the given path. stats are the statistics
+// at the start of the first interval. Returns NULL and prints an error if the
+// file cannot be opened.
+struct interval_sink *interval_sink_new(const char *path, enum event_sink_format format,
+                                        const struct cache_system_stats *stats);
+
+// End the current interval at trace position end, with the given statistics,
+// and start the next one.
+void interval_sink_write(struct interval_sink *sink, uint64_t end,
+                         const struct cache_system_stats *stats);
+
+// Count the current interval from the given statistics instead, e.g. after
+// they were reset.
+void interval_sink_rebase(struct interval_sink *sink, const struct cache_system_stats *stats);
+
+// Close the file and free the sink. Returns 0 if everything was written.
+int interval_sink_close(struct interval_sink *sink);
+
+#endif
@@ -0,0 +1,117 @@
+//
+// This file contains the implementations for the functions defined in
+// line_set.h.
+//
+
+#include "line_set.h"
+
+#include <stdlib.h>
+
+#include "checkpoint.h"
+
+// Fibonacci hashing: spreads consecutive line IDs over the whole table.
+static inline uint64_t line_set_slot(const struct line_set *set, uint64_t line_id)
+{
+    return ((line_id + 1) * UINT64_C(0x9e3779b97f4a7c15) >> 20) & (set->capacity - 1);
+}
+
+static void line_set_grow(struct line_set *set)
+{
+    uint64_t *old_slots = set->slots;
+    uint64_t old_capacity = set->capacity;
+
+    set->capacity *= 2;
+    set->slots = calloc(set->capacity, sizeof(uint64_t));
+    for (uint64_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i] == 0) continue;
+        uint64_t slot = line_set_slot(set, old_slots[i] - 1);
+        while (set->slots[slot] != 0) slot = (slot + 1) & (set->capacity - 1);
+        set->slots[slot] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+void line_set_init(struct line_set *set, uint64_t initial_capacity)
+{
+    set->capacity = 16;
+    while (set->capacity < initial_capacity) set->capacity *= 2;
+    set->slots = calloc(set->capacity, sizeof(uint64_t));
+    set->size = 0;
+}
+
+void line_set_cleanup(struct line_set *set)
+{
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = set->size = 0;
+}
+
+bool line_set_contains(const struct line_set *set, uint64_t line_id)
+{
+    uint64_t slot = line_set_slot(set, line_id);
+    while (set->slots[slot] != 0) {
+        if (set->slots[slot] == line_id + 1) return true;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+bool line_set_insert(struct line_set *set, uint64_t line_id)
+{
+    uint64_t slot = line_set_slot(set, line_id);
+    while (set->slots[slot] != 0) {
+        if (set->slots[slot] == line_id + 1) return false;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+
+    set->slots[slot] = line_id + 1;
+    set->size++;
+    if (set->size * 2 > set->capacity) line_set_grow(set);
+    return true;
+}
+
+bool line_set_remove(struct line_set *set, uint64_t line_id)
+{
+    uint64_t mask = set->capacity - 1;
+    uint64_t slot = line_set_slot(set, line_id);
+    while (set->slots[slot] != line_id + 1) {
+        if (set->slots[slot] == 0) return false;
+        slot = (slot + 1) & mask;
+    }
+
+    // Shift later entries of the probe run back into the hole, so that every
+    // entry stays reachable from its home slot without tombstones.
+    uint64_t hole = slot;
+    for (uint64_t next = (hole + 1) & mask; set->slots[next] != 0; next = (next + 1) & mask) {
+        uint64_t home = line_set_slot(set, set->slots[next] - 1);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            set->slots[hole] = set->slots[next];
+            hole = next;
+        }
+    }
+    set->slots[hole] = 0;
+    set->size--;
+    return true;
+}
+
+int line_set_save(const struct line_set *set, struct checkpoint *checkpoint)
+{
+    checkpoint_write(checkpoint, &set->size, sizeof(set->size));
+    for (uint64_t i = 0; i < set->capacity; i++) {
+        if (set->slots[i] == 0) continue;
+        uint64_t line_id = set->slots[i] - 1;
+        checkpoint_write(checkpoint, &line_id, sizeof(line_id));
+    }
+    return checkpoint_status(checkpoint);
+}
+
+int line_set_load(struct line_set *set, struct checkpoint *checkpoint)
+{
+    uint64_t size = 0, line_id;
+    checkpoint_read(checkpoint, &size, sizeof(size));
+    for (uint64_t i = 0; i < size; i++) {
+        if (checkpoint_read(checkpoint, &line_id, sizeof(line_id)) != 0) return 1;
+        line_set_insert(set, line_id);
+    }
+    return checkpoint_status(checkpoint);
+}
@@ -0,0 +1,41 @@
+//
+// This file defines a set of line IDs, used by the cache system to remember
+// which lines have ever been accessed.
+//
+// The set uses open addressing with linear probing over a single flat array,
+// so inserting does no per-element allocation and a lookup usually touches a
+// single cache line. The array doubles whenever it becomes half full, so
+// lookups stay O(1) on average however many distinct lines a trace touches.
+//
+
+#ifndef LINE_SET_H
+#define LINE_SET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct checkpoint;
+
+struct line_set {
+    uint64_t *slots; // line ID + 1 for each occupied slot, 0 for empty slots
+    uint64_t capacity, size;
+};
+
+// Initialize an empty set. The capacity is rounded up to a power of two.
+void line_set_init(struct line_set *set, uint64_t initial_capacity);
+void line_set_cleanup(struct line_set *set);
+
+bool line_set_contains(const struct line_set *set, uint64_t line_id);
+
+// Add the line ID to the set. Returns true if it was not already in the set.
+bool line_set_insert(struct line_set *set, uint64_t line_id);
+
+// Remove the line ID from the set. Returns true if it was in the set.
+bool line_set_remove(struct line_set *set, uint64_t line_id);
+
+// Write the members of the set to a snapshot, or add the members saved in a
+// snapshot to the set (see checkpoint.h). Return 0 on success.
+int line_set_save(const struct line_set *set, struct checkpoint *checkpoint);
+int line_set_load(struct line_set *set, struct checkpoint *checkpoint);
+
+#endif
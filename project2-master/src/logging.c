@@ -0,0 +1,74 @@
+//
+// This file contains the implementations for the functions defined in
+// logging.h.
+//
+
+#include "logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define EVENT_SINK_CAPACITY 65536
+
+enum verbosity verbosity = VERBOSITY_TRACE;
+
+bool verbosity_parse(const char *str, enum verbosity *out)
+{
+    static const char *names[] = {"silent", "summary", "trace"};
+    for (int i = 0; i < 3; i++) {
+        if (!strcmp(str, names[i]) || (str[0] == '0' + i && str[1] == '\0')) {
+            *out = (enum verbosity)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Event sink
+// ============================================================================
+static const char *event_type_names[] = {"hit", "miss", "evict", "fill"};
+
+struct event_sink *event_sink_new(const char *path, enum event_sink_format format)
+{
+    FILE *file = fopen(path, format == EVENT_SINK_BINARY ? "wb" : "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open event log %s\n", path);
+        return NULL;
+    }
+
+    struct event_sink *sink = calloc(1, sizeof(struct event_sink));
+    sink->file = file;
+    sink->format = format;
+    sink->capacity = EVENT_SINK_CAPACITY;
+    sink->events = malloc(sink->capacity * sizeof(struct cache_event));
+
+    if (format == EVENT_SINK_CSV) {
+        fprintf(file, "sequence,type,address,set,way,tag,prefetch,write,dirty\n");
+    }
+    return sink;
+}
+
+void event_sink_flush(struct event_sink *sink)
+{
+    if (sink->format == EVENT_SINK_BINARY) {
+        fwrite(sink->events, sizeof(struct cache_event), sink->count, sink->file);
+    } else {
+        for (size_t i = 0; i < sink->count; i++) {
+            struct cache_event *e = &sink->events[i];
+            fprintf(sink->file, "%llu,%s,0x%llx,%u,%u,0x%llx,%d,%d,%d\n",
+                    (unsigned long long)e->sequence, event_type_names[e->type],
+                    (unsigned long long)e->address, e->set_idx, e->way, (unsigned long long)e->tag,
+                    !!(e->flags & CACHE_EVENT_FLAG_PREFETCH), !!(e->flags & CACHE_EVENT_FLAG_WRITE),
+                    !!(e->flags & CACHE_EVENT_FLAG_DIRTY));
+        }
+    }
+    sink->count = 0;
+}
+
+void event_sink_close(struct event_sink *sink)
+{
+    event_sink_flush(sink);
+    fclose(sink->file);
+    free(sink->events);
+    free(sink);
+}
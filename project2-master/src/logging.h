@@ -0,0 +1,115 @@
+//
+// This file defines the verbosity levels used to control how much cachesim
+// prints, and the buffered event sink used to record a structured per-access
+// log of what the cache system did.
+//
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// How much output to produce. Each level includes everything printed by the
+// levels before it.
+enum verbosity {
+    VERBOSITY_SILENT,  // Only print the statistics.
+    VERBOSITY_SUMMARY, // Also print the parameters and the cache geometry.
+    VERBOSITY_TRACE,   // Also print a line for every access, hit, miss, etc.
+};
+
+// The highest verbosity that the binary supports. Building with
+// -DCACHESIM_MAX_VERBOSITY=0 turns every trace_printf into dead code.
+#ifndef CACHESIM_MAX_VERBOSITY
+#define CACHESIM_MAX_VERBOSITY VERBOSITY_TRACE
+#endif
+
+// The active verbosity. Defaults to VERBOSITY_TRACE.
+extern enum verbosity verbosity;
+
+#define verbosity_at_least(level) (CACHESIM_MAX_VERBOSITY >= (level) && verbosity >= (level))
+
+// Print only if running at VERBOSITY_TRACE.
+#define trace_printf(...)                                                                          \
+    do {                                                                                           \
+        if (verbosity_at_least(VERBOSITY_TRACE)) printf(__VA_ARGS__);                              \
+    } while (0)
+
+// Print only if running at VERBOSITY_SUMMARY or above.
+#define summary_printf(...)                                                                        \
+    do {                                                                                           \
+        if (verbosity_at_least(VERBOSITY_SUMMARY)) printf(__VA_ARGS__);                            \
+    } while (0)
+
+// Parse a verbosity name ("silent", "summary", "trace") or number. Returns
+// false if the string is not a valid verbosity.
+bool verbosity_parse(const char *str, enum verbosity *out);
+
+// Event sink
+// ============================================================================
+enum cache_event_type {
+    CACHE_EVENT_HIT,   // The access hit in the cache.
+    CACHE_EVENT_MISS,  // The access missed in the cache.
+    CACHE_EVENT_EVICT, // A line was evicted to make room for a fill.
+    CACHE_EVENT_FILL,  // A line was stored into the cache.
+};
+
+// Flags describing an event.
+#define CACHE_EVENT_FLAG_PREFETCH 0x1 // The access was a prefetch.
+#define CACHE_EVENT_FLAG_WRITE 0x2    // The access was a write.
+#define CACHE_EVENT_FLAG_DIRTY 0x4    // The evicted line was dirty.
+
+// A single event. This is also the record layout of binary event logs.
+struct cache_event {
+    uint64_t sequence; // Index of the demand access that caused the event.
+    uint64_t address;
+    uint64_t tag;
+    uint32_t set_idx;
+    uint32_t way;
+    uint8_t type; // An enum cache_event_type
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+enum event_sink_format {
+    EVENT_SINK_CSV,
+    EVENT_SINK_BINARY,
+};
+
+// An event sink buffers events in memory and writes them out in large blocks.
+struct event_sink {
+    FILE *file;
+    enum event_sink_format format;
+    struct cache_event *events;
+    size_t count, capacity;
+    uint64_t sequence; // The current demand access index.
+};
+
+// Open an event sink writing to the given path. Returns NULL and prints an
+// error if the file cannot be opened.
+struct event_sink *event_sink_new(const char *path, enum event_sink_format format);
+
+// Write out all buffered events.
+void event_sink_flush(struct event_sink *sink);
+
+// Flush the sink, close the file and free the sink.
+void event_sink_close(struct event_sink *sink);
+
+static inline void event_sink_emit(struct event_sink *sink, enum cache_event_type type,
+                                   uint64_t address, uint32_t set_idx, uint32_t way, uint64_t tag,
+                                   uint8_t flags)
+{
+    if (sink->count == sink->capacity) event_sink_flush(sink);
+    struct cache_event *event = &sink->events[sink->count++];
+    event->sequence = sink->sequence;
+    event->address = address;
+    event->set_idx = set_idx;
+    event->way = way;
+    event->tag = tag;
+    event->type = type;
+    event->flags = flags;
+    event->reserved = 0;
+}
+
+#endif
@@ -3,114 +3,520 @@
 //
 // This file handles all of the argument and input parsing as well as the
 // output printing. It calls the active cache system for each of the memory
-// accesses received via stdin.
+// accesses received via stdin (or read from the trace given with --trace).
+//
+// Usage:
+//      cachesim [options] POLICY SIZE LINES ASSOCIATIVITY PREFETCHER AMOUNT
+//      cachesim [options] --resume SNAPSHOT
+//
+// Options:
+//      -t, --trace FILE          read the trace from FILE instead of stdin
+//      -v, --verbosity LEVEL     silent, summary or trace (default: trace)
+//      -q, --quiet               same as --verbosity silent
+//      -e, --events FILE         write a log of every cache event to FILE
+//      -E, --events-format FMT   csv or binary (default: csv)
+//      -s, --seed N              seed for random replacement decisions
+//                                (default: the current time)
+//      -d, --prefetch-distance N how many strides ahead of a stream the
+//                                CUSTOM prefetcher starts (default: 1)
+//      -f, --prefetch-filter     drop prefetches of lines that are already in
+//                                the cache or were recently prefetched
+//      -x, --extended-stats      also print the statistics that are not part
+//                                of the standard output
+//      -3, --three-c             separate the capacity misses from the
+//                                conflict misses (see shadow_cache.h)
+//      -c, --checkpoint FILE     save a snapshot of the simulation to FILE at
+//                                the end of the trace, or when interrupted by
+//                                SIGINT or SIGTERM (see checkpoint.h)
+//      -C, --checkpoint-every N  also save the snapshot every N accesses
+//      -r, --resume FILE         restore the simulation from a snapshot and
+//                                continue the trace after the accesses it had
+//                                already simulated. The configuration
+//                                (including -d, -f and -3) comes from the
+//                                snapshot, so no arguments are given.
+//      --restart-trace           with --resume, simulate the trace from its
+//                                start, e.g. to run a different trace from a
+//                                warmed-up snapshot
+//      -w, --warmup N            reset the statistics after the first N
+//                                accesses of the trace, so that only the rest
+//                                is counted
+//      -i, --interval K          split the trace into intervals of K accesses
+//                                and write the statistics of each one to the
+//                                interval log (see intervals.h)
+//      -I, --interval-log FILE   where to write the interval log
+//      --interval-format FMT     csv or binary (default: csv)
+//      -p, --set-profile FILE    count the accesses, misses and evictions of
+//                                each set and write them to FILE (see
+//                                set_profile.h)
+//      --set-profile-format FMT  csv, heatmap or ranked (default: ranked)
+//
+// Subcommands:
+//      cachesim sweep ...        simulate many configurations at once (see
+//                                sweep.h)
+//      cachesim mrc ...          compute the LRU miss ratio curve in one pass
+//                                (see stack_distance.h)
+//      cachesim hierarchy ...    simulate several levels of cache (see
+//                                hierarchy.h)
+//      cachesim multicore ...    simulate coherent private caches of several
+//                                cores (see coherence.h)
+//      cachesim gen ...          generate a synthetic trace (see tracegen.h)
 //
 
+#include <getopt.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "checkpoint.h"
+#include "coherence.h"
+#include "config.h"
+#include "hierarchy.h"
+#include "intervals.h"
 #include "memory_system.h"
 #include "replacement_policies.h"
+#include "set_profile.h"
+#include "stack_distance.h"
+#include "sweep.h"
+#include "trace.h"
+#include "tracegen.h"
+
+static const struct option long_options[] = {
+    {"trace", required_argument, NULL, 't'},
+    {"verbosity", required_argument, NULL, 'v'},
+    {"quiet", no_argument, NULL, 'q'},
+    {"events", required_argument, NULL, 'e'},
+    {"events-format", required_argument, NULL, 'E'},
+    {"seed", required_argument, NULL, 's'},
+    {"prefetch-distance", required_argument, NULL, 'd'},
+    {"prefetch-filter", no_argument, NULL, 'f'},
+    {"extended-stats", no_argument, NULL, 'x'},
+    {"three-c", no_argument, NULL, '3'},
+    {"checkpoint", required_argument, NULL, 'c'},
+    {"checkpoint-every", required_argument, NULL, 'C'},
+    {"resume", required_argument, NULL, 'r'},
+    {"restart-trace", no_argument, NULL, 'R'},
+    {"warmup", required_argument, NULL, 'w'},
+    {"interval", required_argument, NULL, 'i'},
+    {"interval-log", required_argument, NULL, 'I'},
+    {"interval-format", required_argument, NULL, 'F'},
+    {"set-profile", required_argument, NULL, 'p'},
+    {"set-profile-format", required_argument, NULL, 'P'},
+    {NULL, 0, NULL, 0},
+};
+
+// Set by SIGINT and SIGTERM when a snapshot was requested, so that the
+// simulation can stop between two batches and save it.
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_interrupt(int signal)
+{
+    interrupted = 1;
+}
 
 int main(int argc, char **argv)
 {
-    // Parse the arguments.
-    if (argc != 7) {
+    // Dispatch to the subcommands.
+    if (argc > 1 && !strcmp(argv[1], "sweep")) {
+        return sweep_main(argc - 1, argv + 1);
+    } else if (argc > 1 && !strcmp(argv[1], "mrc")) {
+        return stack_distance_main(argc - 1, argv + 1);
+    } else if (argc > 1 && !strcmp(argv[1], "hierarchy")) {
+        return hierarchy_main(argc - 1, argv + 1);
+    } else if (argc > 1 && !strcmp(argv[1], "multicore")) {
+        return coherence_main(argc - 1, argv + 1);
+    } else if (argc > 1 && !strcmp(argv[1], "gen")) {
+        return tracegen_main(argc - 1, argv + 1);
+    }
+
+    // Parse the options.
+    char *trace_path = NULL;
+    char *events_path = NULL;
+    char *checkpoint_path = NULL;
+    char *resume_path = NULL;
+    char *intervals_path = NULL;
+    char *profile_path = NULL;
+    enum set_profile_format profile_format = SET_PROFILE_RANKED;
+    enum event_sink_format events_format = EVENT_SINK_CSV, intervals_format = EVENT_SINK_CSV;
+    uint64_t seed = time(NULL), checkpoint_every = 0, warmup = 0, interval = 0;
+    uint32_t prefetch_distance = CONFIG_DEFAULT_PREFETCH_DISTANCE;
+    bool prefetch_filter = false, extended_stats = false, three_c = false, restart_trace = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:v:qe:E:s:d:fx3c:C:r:w:i:I:p:",
+                              long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'v':
+            if (!verbosity_parse(optarg, &verbosity)) {
+                fprintf(stderr, "Unknown verbosity %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'q':
+            verbosity = VERBOSITY_SILENT;
+            break;
+        case 'e':
+            events_path = optarg;
+            break;
+        case 'E':
+            if (!strcmp(optarg, "csv")) {
+                events_format = EVENT_SINK_CSV;
+            } else if (!strcmp(optarg, "binary")) {
+                events_format = EVENT_SINK_BINARY;
+            } else {
+                fprintf(stderr, "Unknown event log format %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'd':
+            prefetch_distance = strtoul(optarg, NULL, 10);
+            if (prefetch_distance == 0) {
+                fprintf(stderr, "Invalid prefetch distance %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            prefetch_filter = true;
+            break;
+        case 'x':
+            extended_stats = true;
+            break;
+        case '3':
+            three_c = true;
+            break;
+        case 'c':
+            checkpoint_path = optarg;
+            break;
+        case 'C':
+            checkpoint_every = strtoull(optarg, NULL, 10);
+            if (checkpoint_every == 0) {
+                fprintf(stderr, "Invalid checkpoint interval %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            resume_path = optarg;
+            break;
+        case 'R':
+            restart_trace = true;
+            break;
+        case 'w':
+            warmup = strtoull(optarg, NULL, 10);
+            break;
+        case 'i':
+            interval = strtoull(optarg, NULL, 10);
+            if (interval == 0) {
+                fprintf(stderr, "Invalid interval %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'I':
+            intervals_path = optarg;
+            break;
+        case 'F':
+            if (!strcmp(optarg, "csv")) {
+                intervals_format = EVENT_SINK_CSV;
+            } else if (!strcmp(optarg, "binary")) {
+                intervals_format = EVENT_SINK_BINARY;
+            } else {
+                fprintf(stderr, "Unknown interval log format %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            profile_path = optarg;
+            break;
+        case 'P':
+            if (!set_profile_format_parse(optarg, &profile_format)) {
+                fprintf(stderr, "Unknown set profile format %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (checkpoint_every > 0 && checkpoint_path == NULL) {
+        fprintf(stderr, "--checkpoint-every needs --checkpoint\n");
+        return 1;
+    }
+    if ((interval > 0) != (intervals_path != NULL)) {
+        fprintf(stderr, "--interval and --interval-log must be given together\n");
+        return 1;
+    }
+
+    // Parse the arguments, or take the configuration from the snapshot.
+    struct cache_config config;
+    memset(&config, 0, sizeof(config));
+    struct cache_system *cache_system = NULL;
+    uint64_t offset = 0;
+    if (resume_path != NULL) {
+        if (argc != optind) {
+            fprintf(stderr, "No arguments are needed with --resume.\n");
+            return 1;
+        }
+        cache_system = checkpoint_restore(resume_path, &config, &offset);
+        if (cache_system == NULL) {
+            return 1;
+        }
+        three_c = cache_system->shadow != NULL;
+        if (restart_trace) {
+            offset = 0;
+        }
+    } else if (argc - optind != 6) {
         fprintf(stderr, "Incorrect number of arguments.\n");
         return 1;
+    } else {
+        argv += optind - 1;
+        char *endptr;
+        snprintf(config.replacement_policy, CONFIG_NAME_SIZE, "%s", argv[1]);
+        config.cache_size = strtol(argv[2], &endptr, 10);
+        config.cache_lines = strtol(argv[3], &endptr, 10);
+        config.associativity = strtol(argv[4], &endptr, 10);
+        snprintf(config.prefetcher, CONFIG_NAME_SIZE, "%s", argv[5]);
+        config.prefetch_amount = strtol(argv[6], &endptr, 10);
+        config.prefetch_distance = prefetch_distance;
+        config.prefetch_filter = prefetch_filter;
+        config.seed = seed;
     }
-    char *replacement_policy_str = argv[1];
-    char *endptr;
-    size_t cache_size = strtol(argv[2], &endptr, 10);
-    size_t cache_lines = strtol(argv[3], &endptr, 10);
-    size_t associativity = strtol(argv[4], &endptr, 10);
-    char *prefetch_strategy = argv[5];
-    size_t prefetch_amount = strtol(argv[6], &endptr, 10);
 
     // TODO: calculate the line size and number of sets.
-    int line_size = cache_size / cache_lines;
-    int sets = cache_lines / associativity;
+    int line_size = config.cache_size / config.cache_lines;
+    int sets = config.cache_lines / config.associativity;
 
     // Print out some parameter info
-    printf("Parameter Info\n");
-    printf("==============\n");
-    printf("Replacement Policy: %s\n", replacement_policy_str);
-    printf("Prefetch Strategy: %s\n", prefetch_strategy);
-    printf("Prefetch Amount: %ld\n", prefetch_amount);
-    printf("Cache Size: %ld\n", cache_size);
-    printf("Cache Lines: %ld\n", cache_lines);
-    printf("Associativity: %ld\n", associativity);
-    printf("Line Size: %dB\n", line_size);
-    printf("Number of Sets: %d\n", sets);
-
-    // Instantiate the cache system.
-    struct cache_system *cache_system = cache_system_new(line_size, sets, associativity);
-
-    // Instantiate the replacement policy
-    struct replacement_policy *replacement_policy;
-    if (!strcmp("LRU", replacement_policy_str)) {
-        replacement_policy =
-            lru_replacement_policy_new(cache_system->num_sets, cache_system->associativity);
-    } else if (!strcmp("RAND", replacement_policy_str)) {
-        replacement_policy =
-            rand_replacement_policy_new(cache_system->num_sets, cache_system->associativity);
-    } else if (!strcmp("LRU_PREFER_CLEAN", replacement_policy_str)) {
-        replacement_policy = lru_prefer_clean_replacement_policy_new(cache_system->num_sets,
-                                                                     cache_system->associativity);
-    } else {
-        fprintf(stderr, "Unknown replacement policy %s", replacement_policy_str);
+    summary_printf("Parameter Info\n");
+    summary_printf("==============\n");
+    summary_printf("Replacement Policy: %s\n", config.replacement_policy);
+    summary_printf("Prefetch Strategy: %s\n", config.prefetcher);
+    summary_printf("Prefetch Amount: %u\n", config.prefetch_amount);
+    summary_printf("Cache Size: %u\n", config.cache_size);
+    summary_printf("Cache Lines: %u\n", config.cache_lines);
+    summary_printf("Associativity: %u\n", config.associativity);
+    summary_printf("Line Size: %dB\n", line_size);
+    summary_printf("Number of Sets: %d\n", sets);
+    if (resume_path != NULL) {
+        summary_printf("Resumed From: %s (after %llu accesses)\n", resume_path,
+                       (unsigned long long)offset);
+    }
+
+    if (cache_system == NULL) {
+        // Instantiate the cache system.
+        cache_system = cache_system_new(line_size, sets, config.associativity);
+
+        // Instantiate the replacement policy
+        struct replacement_policy *replacement_policy = replacement_policy_new_by_name(
+            config.replacement_policy, cache_system->num_sets, cache_system->associativity, seed);
+        if (replacement_policy == NULL) {
+            return 1;
+        }
+        cache_system_set_replacement_policy(cache_system, replacement_policy);
+
+        // Instantiate the prefetcher
+        cache_system->prefetcher = prefetcher_new_by_name(
+            config.prefetcher, config.prefetch_amount, prefetch_distance);
+        if (cache_system->prefetcher == NULL) {
+            return 1;
+        }
+        if (prefetch_filter) {
+            cache_system_enable_prefetch_filter(cache_system);
+        }
+        if (three_c) {
+            cache_system_enable_three_c(cache_system);
+        }
+    }
+
+    // Set up the event log if one was requested.
+    if (events_path != NULL) {
+        cache_system->events = event_sink_new(events_path, events_format);
+        if (cache_system->events == NULL) {
+            return 1;
+        }
+    }
+
+    // The set profile is not part of snapshots, so it only covers this run.
+    if (profile_path != NULL) {
+        cache_system_enable_set_profile(cache_system);
+    }
+
+    // Set up the interval log if one was requested.
+    struct interval_sink *intervals = NULL;
+    if (intervals_path != NULL) {
+        intervals = interval_sink_new(intervals_path, intervals_format, &cache_system->stats);
+        if (intervals == NULL) {
+            return 1;
+        }
+    }
+
+    // Stop cleanly on SIGINT and SIGTERM if there is somewhere to save the
+    // simulation.
+    if (checkpoint_path != NULL) {
+        signal(SIGINT, handle_interrupt);
+        signal(SIGTERM, handle_interrupt);
+    }
+
+    // Open the trace. Binary traces are memory-mapped and the records are
+    // handed to the cache system straight from the mapping.
+    struct trace_reader *trace = trace_reader_open(trace_path);
+    if (trace == NULL) {
         return 1;
     }
 
-    cache_system->replacement_policy = replacement_policy;
+    // Read the input and hand each batch of records to the cache system,
+    // skipping the records that the snapshot already covers. position is the
+    // number of records simulated so far, including those before the
+    // snapshot. The batches are split wherever something has to happen
+    // between two accesses: at the end of the warmup, of an interval, or
+    // before a periodic snapshot. Intervals and snapshots are at multiples of
+    // their length, so they line up across resumed runs.
+    uint64_t *addresses = malloc(TRACE_BATCH_SIZE * sizeof(uint64_t));
+    char *rws = malloc(TRACE_BATCH_SIZE);
+    const struct trace_record *records;
+    size_t count;
+    uint64_t skip = offset, position = offset;
+    uint64_t next_checkpoint = checkpoint_every > 0 ? position + checkpoint_every : UINT64_MAX;
+    uint64_t next_interval = interval > 0 ? (position / interval + 1) * interval : UINT64_MAX;
+    uint64_t interval_start = position;
+    uint64_t next_warmup = warmup > position ? warmup : UINT64_MAX;
+    while (!interrupted && (count = trace_reader_next(trace, &records)) > 0) {
+        if (skip >= count) {
+            skip -= count;
+            continue;
+        }
+        records += skip;
+        count -= skip;
+        skip = 0;
 
-    // Instantiate the prefetcher
-    struct prefetcher *prefetcher;
-    if (!strcmp("NULL", prefetch_strategy)) {
-        prefetcher = null_prefetcher_new();
-    } else if (!strcmp("ADJACENT", prefetch_strategy)) {
-        prefetcher = adjacent_prefetcher_new();
-    } else if (!strcmp("SEQUENTIAL", prefetch_strategy)) {
-        prefetcher = sequential_prefetcher_new(prefetch_amount);
-    } else if (!strcmp("CUSTOM", prefetch_strategy)) {
-        prefetcher = custom_prefetcher_new();
-    } else {
-        fprintf(stderr, "Unknown replacement policy %s", prefetch_strategy);
+        for (size_t done = 0; done < count;) {
+            uint64_t next_stop = next_checkpoint < next_interval ? next_checkpoint : next_interval;
+            if (next_warmup < next_stop) next_stop = next_warmup;
+            size_t n = count - done;
+            if (n > next_stop - position) n = next_stop - position;
+            for (size_t i = 0; i < n; i++) {
+                addresses[i] = trace_record_address(records[done + i]);
+                rws[i] = trace_record_rw(records[done + i]);
+            }
+            if (cache_system_mem_access_batch(cache_system, addresses, rws, n) != 0) {
+                return 1;
+            }
+            done += n;
+            position += n;
+            if (position == next_interval) {
+                interval_sink_write(intervals, position, &cache_system->stats);
+                interval_start = position;
+                next_interval += interval;
+            }
+            if (position == next_warmup) {
+                cache_system_reset_stats(cache_system);
+                if (intervals) interval_sink_rebase(intervals, &cache_system->stats);
+                next_warmup = UINT64_MAX;
+            }
+            if (position == next_checkpoint) {
+                if (checkpoint_save(checkpoint_path, &config, position, cache_system) != 0) {
+                    return 1;
+                }
+                next_checkpoint += checkpoint_every;
+            }
+        }
+    }
+    int trace_status = trace_reader_close(trace);
+    free(addresses);
+    free(rws);
+    // After an interruption the decompressor may have been stopped by the
+    // same signal, but everything simulated so far is still worth saving.
+    if (trace_status != 0 && !interrupted) {
+        return 1;
+    }
+    if (skip > 0) {
+        fprintf(stderr, "The trace is shorter than the %llu accesses in the snapshot\n",
+                (unsigned long long)offset);
         return 1;
     }
-    cache_system->prefetcher = prefetcher;
 
-    // Read the input and call the cache system mem_access function.
-    char rw = 0;
-    uint32_t address = 0;
-    while (scanf("%c %x\n", &rw, &address) >= 0) {
-        printf("%s at 0x%x\n", (rw == 'R' ? "read" : "write"), address);
-        if (cache_system_mem_access(cache_system, address, rw, false) != 0) {
+    // Finish the last, partial interval.
+    if (intervals != NULL) {
+        if (position > interval_start) {
+            interval_sink_write(intervals, position, &cache_system->stats);
+        }
+        if (interval_sink_close(intervals) != 0) {
+            fprintf(stderr, "Failed to write the interval log %s\n", intervals_path);
             return 1;
         }
     }
 
+    // Write the set profile.
+    if (profile_path != NULL) {
+        FILE *file = fopen(profile_path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open set profile %s\n", profile_path);
+            return 1;
+        }
+        int status = set_profile_write(cache_system->profile, file, profile_format);
+        if (fclose(file) != 0 || status != 0) {
+            fprintf(stderr, "Failed to write the set profile %s\n", profile_path);
+            return 1;
+        }
+    }
+
+    // Save the final state. After an interruption, that is all there is to do.
+    if (checkpoint_path != NULL &&
+        checkpoint_save(checkpoint_path, &config, position, cache_system) != 0) {
+        return 1;
+    }
+    if (interrupted) {
+        fprintf(stderr, "Interrupted after %llu accesses; saved a snapshot to %s\n",
+                (unsigned long long)position, checkpoint_path);
+        return 1;
+    }
+
     // Print the statistics
+    struct cache_system_stats *stats = &cache_system->stats;
     printf("\n\nStatistics\n");
     printf("==========\n");
-    printf("OUTPUT ACCESSES %d\n", cache_system->stats.accesses);
-    printf("OUTPUT HITS %d\n", cache_system->stats.hits);
-    printf("OUTPUT MISSES %d\n", cache_system->stats.misses);
-    printf("OUTPUT PREFETCHES %d\n", cache_system->stats.prefetches);
-    printf("OUTPUT COMPULSORY MISSES %d\n", cache_system->stats.compulsory_misses);
-    printf("OUTPUT CONFLICT MISSES %d\n", cache_system->stats.conflict_misses);
-    printf("OUTPUT DIRTY EVICTIONS %d\n", cache_system->stats.dirty_evictions);
-    printf("OUTPUT HIT RATIO %.8f\n",
-           (double)cache_system->stats.hits / cache_system->stats.accesses);
+    printf("OUTPUT ACCESSES %llu\n", (unsigned long long)stats->accesses);
+    printf("OUTPUT HITS %llu\n", (unsigned long long)stats->hits);
+    printf("OUTPUT MISSES %llu\n", (unsigned long long)stats->misses);
+    printf("OUTPUT PREFETCHES %llu\n", (unsigned long long)stats->prefetches);
+    printf("OUTPUT COMPULSORY MISSES %llu\n", (unsigned long long)stats->compulsory_misses);
+    printf("OUTPUT CONFLICT MISSES %llu\n", (unsigned long long)stats->conflict_misses);
+    if (three_c) {
+        printf("OUTPUT CAPACITY MISSES %llu\n", (unsigned long long)stats->capacity_misses);
+    }
+    printf("OUTPUT DIRTY EVICTIONS %llu\n", (unsigned long long)stats->dirty_evictions);
+    printf("OUTPUT HIT RATIO %.8f\n", (double)stats->hits / stats->accesses);
+    if (extended_stats) {
+        printf("OUTPUT PREFETCHES FILTERED %llu\n",
+               (unsigned long long)stats->prefetches_filtered);
+        printf("OUTPUT PREFETCHES FILLED %llu\n", (unsigned long long)stats->prefetches_filled);
+        printf("OUTPUT USEFUL PREFETCHES %llu\n", (unsigned long long)stats->useful_prefetches);
+        printf("OUTPUT USELESS PREFETCHES %llu\n",
+               (unsigned long long)stats->useless_prefetches);
+        printf("OUTPUT POLLUTION EVICTIONS %llu\n",
+               (unsigned long long)stats->pollution_evictions);
+        printf("OUTPUT LATE PREFETCHES %llu\n", (unsigned long long)stats->late_prefetches);
 
-    // Clean everything up.
-    cache_system_cleanup(cache_system);
-    free(cache_system);
+        // Accuracy is the fraction of filled prefetches that were used, and
+        // coverage the fraction of the misses (without prefetching) that the
+        // prefetches removed.
+        uint64_t useful = stats->useful_prefetches;
+        printf("OUTPUT PREFETCH ACCURACY %.8f\n",
+               stats->prefetches_filled ? (double)useful / stats->prefetches_filled : 0.0);
+        printf("OUTPUT PREFETCH COVERAGE %.8f\n",
+               useful + stats->misses ? (double)useful / (useful + stats->misses) : 0.0);
+    }
 
-    prefetcher->cleanup(prefetcher);
-    free(prefetcher);
+    // Clean everything up.
+    if (cache_system->events != NULL) {
+        event_sink_close(cache_system->events);
+    }
+    cache_system_destroy(cache_system);
 
     return 0;
 }
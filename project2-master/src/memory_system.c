@@ -6,179 +6,666 @@
 #include "memory_system.h"
 #include "math.h"
 
+#include <string.h>
+
+#include "checkpoint.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 struct cache_system *cache_system_new(uint32_t line_size, uint32_t sets, uint32_t associativity)
 {
     struct cache_system *cs = malloc(sizeof(struct cache_system));
     cs->line_size = line_size;
     cs->num_sets = sets;
     cs->associativity = associativity;
-    struct cache_system_stats stats = {0, 0, 0, 0, 0, 0, 0};
+    struct cache_system_stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     cs->stats = stats;
 
     // TODO: calculate the index bits, offset bits and tag bits.
     cs->index_bits = log2(sets);
     cs->offset_bits = log2(line_size);
-    cs->tag_bits = 32 - cs->index_bits - cs->offset_bits;
-
-    cs->offset_mask = 0xffffffff >> (32 - cs->offset_bits);
-    cs->set_index_mask = 0xffffffff >> cs->tag_bits;
-
-    printf("\nCache System Geometry:\n");
-    printf("Index bits: %d\n", cs->index_bits);
-    printf("Offset bits: %d\n", cs->offset_bits);
-    printf("Tag bits: %d\n", cs->tag_bits);
-    printf("Offset mask: 0x%x\n", cs->offset_mask);
-    printf("Set index mask: 0x%x\n", cs->set_index_mask);
-
-    // We need to allocate an array of cache lines representing the cache lines
-    // across all of the sets in the cache. We are using a single 1-D array
-    // where every "cs->associativity"-sized block of elements represents one
-    // set.
+    cs->tag_bits = 64 - cs->index_bits - cs->offset_bits;
+
+    cs->offset_mask = (UINT64_C(1) << cs->offset_bits) - 1;
+    cs->set_index_mask = (UINT64_C(1) << (cs->offset_bits + cs->index_bits)) - 1;
+
+    summary_printf("\nCache System Geometry:\n");
+    summary_printf("Index bits: %d\n", cs->index_bits);
+    summary_printf("Offset bits: %d\n", cs->offset_bits);
+    summary_printf("Tag bits: %d\n", cs->tag_bits);
+    summary_printf("Offset mask: 0x%llx\n", (unsigned long long)cs->offset_mask);
+    summary_printf("Set index mask: 0x%llx\n", (unsigned long long)cs->set_index_mask);
+
+    // We need to allocate arrays representing the cache lines across all of
+    // the sets in the cache. We are using 1-D arrays where every
+    // "cs->associativity"-sized block of elements represents one set.
     //
     // For example, to access the 2nd element in the 3rd set (assuming
     // associativity = 4), you would access the element at index 3*4 + 1.
-    cs->cache_lines = calloc(cs->num_sets * cs->associativity, sizeof(struct cache_line));
+    cs->tags = calloc(cs->num_sets * cs->associativity, sizeof(uint32_t));
+    cs->tags_high = NULL;
+    cs->tag_high_base = 0;
+    cs->has_tag_high_base = false;
+    cs->statuses = calloc(cs->num_sets * cs->associativity, sizeof(uint8_t));
+    cs->prefetched = calloc(cs->num_sets * cs->associativity, sizeof(uint8_t));
 
     // Allocate space to keep track of which lines were accessed.
-    cs->accessed_lines_hashtable = calloc(ACCESSED_HASHTABLE_SIZE, sizeof(struct accessed_line *));
+    line_set_init(&cs->accessed_lines, ACCESSED_LINES_INITIAL_CAPACITY);
+    memset(cs->recent_misses, 0, sizeof(cs->recent_misses));
+
+    cs->replacement_policy = NULL;
+    cs->prefetcher = NULL;
+    cs->events = NULL;
+    cs->prefetch_queue = NULL;
+    cs->listener = NULL;
+    cs->shadow = NULL;
+    cs->profile = NULL;
     return cs;
 }
 
 void cache_system_cleanup(struct cache_system *cache_system)
 {
-    free(cache_system->cache_lines);
-    cache_system->replacement_policy->cleanup(cache_system->replacement_policy);
-    free(cache_system->replacement_policy);
+    free(cache_system->tags);
+    free(cache_system->tags_high);
+    free(cache_system->statuses);
+    free(cache_system->prefetched);
+    line_set_cleanup(&cache_system->accessed_lines);
+    free(cache_system->prefetch_queue);
+    if (cache_system->shadow != NULL) {
+        shadow_cache_cleanup(cache_system->shadow);
+        free(cache_system->shadow);
+    }
+    if (cache_system->profile != NULL) {
+        set_profile_cleanup(cache_system->profile);
+        free(cache_system->profile);
+    }
+    if (cache_system->replacement_policy != NULL) {
+        cache_system->replacement_policy->cleanup(cache_system->replacement_policy);
+        free(cache_system->replacement_policy);
+    }
 }
 
-int cache_system_mem_access(struct cache_system *cache_system, uint32_t address, char rw,
-                            bool is_prefetch)
+static int cache_system_drain_prefetches(struct cache_system *cache_system);
+
+void cache_system_set_replacement_policy(struct cache_system *cache_system,
+                                         struct replacement_policy *replacement_policy)
 {
-    if (is_prefetch)
-        printf("  prefetch: 0x%x\n", address);
-    else
+    replacement_policy_adapt(replacement_policy);
+    cache_system->replacement_policy = replacement_policy;
+}
+
+// Find a way in the set for a new line: an invalid way if there is one, or
+// else the way chosen by the replacement policy, whose line is evicted.
+// Returns the way, or -1 if the replacement policy chose a way outside the
+// set.
+static int cache_system_make_room(struct cache_system *cache_system, uint32_t set_idx,
+                                  bool is_prefetch, uint8_t event_flags)
+{
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+    struct event_sink *events = cache_system->events;
+    uint32_t set_start = cache_system_line_index(cache_system, set_idx, 0);
+
+    // See if there's an open index.
+    uint8_t *statuses = &cache_system->statuses[set_start];
+    uint8_t *open = memchr(statuses, INVALID, cache_system->associativity);
+    if (open != NULL) return open - statuses;
+
+    // An eviction is necessary. Call the replacement policy's eviction index
+    // function.
+    int evicted_index =
+        (*replacement_policy->eviction_index)(replacement_policy, cache_system, set_idx);
+
+    // Check to ensure that the eviction index is within the set.
+    if (evicted_index < 0 || cache_system->associativity <= evicted_index) {
+        fprintf(stderr, "Eviction index %d is outside of the set!", evicted_index);
+        return -1;
+    }
+
+    // Check if the eviction requires writeback.
+    uint64_t evicted_tag = cache_system_tag(cache_system, set_start + evicted_index);
+    bool evicted_dirty = statuses[evicted_index] == MODIFIED;
+    if (evicted_dirty) {
+        cache_system->stats.dirty_evictions++;
+    }
+    if (cache_system->profile) {
+        cache_system->profile->sets[set_idx].evictions++;
+        if (evicted_dirty) cache_system->profile->sets[set_idx].dirty_evictions++;
+    }
+    if (cache_system->prefetched[set_start + evicted_index]) {
+        cache_system->stats.useless_prefetches++;
+    } else if (is_prefetch) {
+        cache_system->stats.pollution_evictions++;
+    }
+
+    trace_printf("  evict %s cache line from set %d index %d\n",
+                 (evicted_dirty ? "dirty" : "clean"), set_idx, evicted_index);
+    uint64_t evicted_address =
+        ((evicted_tag << cache_system->index_bits) | set_idx) << cache_system->offset_bits;
+    if (events) {
+        event_sink_emit(events, CACHE_EVENT_EVICT, evicted_address, set_idx, evicted_index,
+                        evicted_tag, event_flags | (evicted_dirty ? CACHE_EVENT_FLAG_DIRTY : 0));
+    }
+
+    // Hand the line to the next level.
+    struct cache_system_listener *listener = cache_system->listener;
+    if (listener && (*listener->evict)(listener, cache_system, evicted_address, evicted_dirty)) {
+        return -1;
+    }
+
+    if (replacement_policy->evict) {
+        (*replacement_policy->evict)(replacement_policy, cache_system, set_idx, evicted_index);
+    }
+    return evicted_index;
+}
+
+// The body of cache_system_mem_access, for an address whose set index and tag
+// have already been computed.
+static inline int cache_system_access(struct cache_system *cache_system, uint64_t address,
+                                      uint32_t set_idx, uint64_t tag, char rw, bool is_prefetch)
+{
+    struct event_sink *events = cache_system->events;
+    uint8_t event_flags = (is_prefetch ? CACHE_EVENT_FLAG_PREFETCH : 0) |
+                          (rw == 'W' ? CACHE_EVENT_FLAG_WRITE : 0);
+
+    if (is_prefetch) {
+        trace_printf("  prefetch: 0x%llx\n", (unsigned long long)address);
+    } else {
         cache_system->stats.accesses++;
+        if (events) events->sequence = cache_system->stats.accesses;
+        if (cache_system->profile) cache_system->profile->sets[set_idx].accesses++;
+    }
 
     uint32_t offset = (address & cache_system->offset_mask);
-    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
-    uint32_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
 
     // The line ID is the tag + the set_idx (everything except the offset).
-    uint32_t line_id = address >> cache_system->offset_bits;
+    uint64_t line_id = address >> cache_system->offset_bits;
+
+    // The shadow cache has to see every demand access, hit or miss, to keep
+    // its recency order.
+    bool shadow_hit = false;
+    if (cache_system->shadow && !is_prefetch) {
+        shadow_hit = shadow_cache_access(cache_system->shadow, line_id);
+    }
 
-    struct cache_line *cl = cache_system_find_cache_line(cache_system, set_idx, tag);
-    bool cache_miss = cl == NULL || cl->status == INVALID;
+    uint32_t set_start = cache_system_line_index(cache_system, set_idx, 0);
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+    int way = cache_system_find_way(cache_system, set_idx, tag);
+    bool cache_miss = way < 0;
     if (cache_miss) { // cache miss
-        printf("  0x%x miss\n", address);
-        if (!is_prefetch) {
-            cache_system->stats.misses++;
-            // Determine if it's a compulsory or conflict
-            if (cache_system_line_in_accessed_set(cache_system, line_id)) {
-                cache_system->stats.conflict_misses++;
-            } else {
-                cache_system->stats.compulsory_misses++;
-                cache_system_line_id_add(cache_system, line_id);
-            }
-        }
+        trace_printf("  0x%llx miss\n", (unsigned long long)address);
+        if (events) event_sink_emit(events, CACHE_EVENT_MISS, address, set_idx, 0, tag, event_flags);
 
-        // See if there's an open index.
-        int insert_index = -1;
-        int set_start = set_idx * cache_system->associativity;
-        struct cache_line *start = &cache_system->cache_lines[set_start];
-        for (int i = 0; start + i < start + cache_system->associativity; i++) {
-            if ((start + i)->status == INVALID) {
-                insert_index = i;
-                break;
-            }
+        // Fetch the line from the next level, if there is one.
+        uint8_t fill_status = (rw == 'W') ? MODIFIED : EXCLUSIVE;
+        struct cache_system_listener *listener = cache_system->listener;
+        if (listener) {
+            int status = (*listener->fill)(listener, cache_system, address, is_prefetch,
+                                           &fill_status);
+            if (status == CACHE_SYSTEM_FILL_DROPPED && is_prefetch) return 0;
+            if (status != 0) return 1;
         }
 
-        if (insert_index < 0) {
-            // An eviction is necessary. Call the replacement policy's eviction
-            // index function.
-            int evicted_index = (*cache_system->replacement_policy->eviction_index)(
-                cache_system->replacement_policy, cache_system, set_idx);
-
-            // Check to ensure that the eviction index is within the set.
-            if (evicted_index < 0 || cache_system->associativity <= evicted_index) {
-                fprintf(stderr, "Eviction index %d is outside of the set!", evicted_index);
-                return 1;
+        if (is_prefetch) {
+            cache_system->stats.prefetches_filled++;
+        } else {
+            cache_system->stats.misses++;
+            // Determine if it's a compulsory, capacity or conflict miss.
+            // Inserting tells us whether the line was already in the set with
+            // a single lookup.
+            bool compulsory = line_set_insert(&cache_system->accessed_lines, line_id);
+            bool conflict = false;
+            if (compulsory) {
+                cache_system->stats.compulsory_misses++;
+            } else if (cache_system->shadow && !shadow_hit) {
+                cache_system->stats.capacity_misses++;
+            } else {
+                cache_system->stats.conflict_misses++;
+                conflict = true;
             }
-
-            // Check if the eviction requires writeback.
-            struct cache_line evicted = cache_system->cache_lines[set_start + evicted_index];
-            if (evicted.status == MODIFIED) {
-                cache_system->stats.dirty_evictions++;
+            if (cache_system->profile) {
+                set_profile_miss(cache_system->profile, set_idx, tag, !compulsory, conflict);
             }
 
-            printf("  evict %s cache line from set %d index %d\n",
-                   (evicted.status == MODIFIED ? "dirty" : "clean"), set_idx, evicted_index);
+            struct recent_miss *recent =
+                &cache_system->recent_misses[line_id & (PREFETCH_LATE_TABLE_SIZE - 1)];
+            recent->line_id = line_id;
+            recent->access = cache_system->stats.accesses;
+        }
 
-            // Use the evicted index as the insert index.
-            insert_index = evicted_index;
+        int insert_index = cache_system_make_room(cache_system, set_idx, is_prefetch, event_flags);
+        if (insert_index < 0) return 1;
+        uint8_t *statuses = &cache_system->statuses[set_start];
+
+        trace_printf("  store cache line with tag 0x%llx in set %d index %d\n",
+                     (unsigned long long)tag, set_idx, insert_index);
+        if (events) {
+            event_sink_emit(events, CACHE_EVENT_FILL, address, set_idx, insert_index, tag,
+                            event_flags);
         }
 
-        printf("  store cache line with tag 0x%x in set %d index %d\n", tag, set_idx, insert_index);
+        // Change the tag of the cache line.
+        cache_system_set_tag(cache_system, set_start + insert_index, tag);
+        statuses[insert_index] = fill_status;
+        cache_system->prefetched[set_start + insert_index] = is_prefetch;
+        way = insert_index;
 
-        // Change the tag of the cache line, and set cl to this cache line.
-        cl = &cache_system->cache_lines[set_start + insert_index];
-        cl->tag = tag;
-        cl->status = (rw == 'W') ? MODIFIED : EXCLUSIVE;
+        if (replacement_policy->fill) {
+            (*replacement_policy->fill)(replacement_policy, cache_system, set_idx, way, rw);
+        }
     } else { // cache hit
-        printf("  0x%x hit: set %d, tag 0x%x, offset %d\n", address, set_idx, tag, offset);
-        if (!is_prefetch) cache_system->stats.hits++;
-        if (rw == 'W') cl->status = MODIFIED;
+        trace_printf("  0x%llx hit: set %d, tag 0x%llx, offset %d\n", (unsigned long long)address,
+                     set_idx, (unsigned long long)tag, offset);
+        if (events) event_sink_emit(events, CACHE_EVENT_HIT, address, set_idx, way, tag, event_flags);
+        if (!is_prefetch) {
+            cache_system->stats.hits++;
+            if (cache_system->prefetched[set_start + way]) {
+                cache_system->stats.useful_prefetches++;
+                cache_system->prefetched[set_start + way] = false;
+            }
+        }
+        if (rw == 'W') {
+            // Other caches have to give up their copies of a shared line first.
+            uint8_t *status = &cache_system->statuses[set_start + way];
+            struct cache_system_listener *listener = cache_system->listener;
+            if (*status == SHARED && listener && listener->upgrade &&
+                (*listener->upgrade)(listener, cache_system, address) != 0) {
+                return 1;
+            }
+            *status = MODIFIED;
+        }
     }
 
     // Let the replacement policy know that the cache line was accessed.
-    (*cache_system->replacement_policy->cache_access)(cache_system->replacement_policy,
-                                                      cache_system, set_idx, tag);
+    if (replacement_policy->access) {
+        (*replacement_policy->access)(replacement_policy, cache_system, set_idx, way, !cache_miss,
+                                      rw);
+    }
 
     // Call the prefetcher if this isn't a prefetch.
     if (!is_prefetch) {
         cache_system->stats.prefetches += (*cache_system->prefetcher->handle_mem_access)(
             cache_system->prefetcher, cache_system, address, cache_miss);
+        if (cache_system->prefetch_queue) return cache_system_drain_prefetches(cache_system);
     }
 
     // Everything was successful.
     return 0;
 }
 
-void cache_system_line_id_add(struct cache_system *cache_system, uint32_t line_id)
+int cache_system_mem_access(struct cache_system *cache_system, uint64_t address, char rw,
+                            bool is_prefetch)
 {
-    int hashtable_idx = line_id % ACCESSED_HASHTABLE_SIZE;
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    return cache_system_access(cache_system, address, set_idx, tag, rw, is_prefetch);
+}
 
-    struct accessed_line *new_accessed = malloc(sizeof(struct accessed_line));
-    new_accessed->line_id = line_id;
-    new_accessed->next = cache_system->accessed_lines_hashtable[hashtable_idx];
+int cache_system_mem_access_batch(struct cache_system *cache_system, const uint64_t *addresses,
+                                  const char *rws, size_t count)
+{
+    uint32_t set_idxs[CACHE_SYSTEM_BATCH_CHUNK];
+    uint64_t tags[CACHE_SYSTEM_BATCH_CHUNK];
+    uint64_t set_index_mask = cache_system->set_index_mask;
+    uint32_t offset_bits = cache_system->offset_bits;
+    uint32_t tag_shift = cache_system->offset_bits + cache_system->index_bits;
 
-    cache_system->accessed_lines_hashtable[hashtable_idx] = new_accessed;
+    for (size_t start = 0; start < count; start += CACHE_SYSTEM_BATCH_CHUNK) {
+        size_t n = count - start < CACHE_SYSTEM_BATCH_CHUNK ? count - start
+                                                            : CACHE_SYSTEM_BATCH_CHUNK;
+        const uint64_t *chunk = &addresses[start];
+
+        // Split the addresses up front. There are no dependencies between
+        // iterations, so the compiler vectorizes this loop.
+        for (size_t i = 0; i < n; i++) {
+            set_idxs[i] = (chunk[i] & set_index_mask) >> offset_bits;
+            tags[i] = chunk[i] >> tag_shift;
+        }
+
+        // The accesses themselves have to happen in order, since each one can
+        // change the set (and the replacement and prefetcher state) for the
+        // next.
+        for (size_t i = 0; i < n; i++) {
+            char rw = rws[start + i];
+            trace_printf("%s at 0x%llx\n", (rw == 'R' ? "read" : "write"),
+                         (unsigned long long)chunk[i]);
+            if (cache_system_access(cache_system, chunk[i], set_idxs[i], tags[i], rw, false) != 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
 }
 
-bool cache_system_line_in_accessed_set(struct cache_system *cache_system, uint32_t line_id)
+void cache_system_enable_three_c(struct cache_system *cache_system)
 {
-    int hashtable_idx = line_id % ACCESSED_HASHTABLE_SIZE;
-    struct accessed_line *current = cache_system->accessed_lines_hashtable[hashtable_idx];
-    while (current != NULL) {
-        if (current->line_id == line_id) {
-            return true; // This line was accessed before.
+    if (cache_system->shadow == NULL) {
+        cache_system->shadow = malloc(sizeof(struct shadow_cache));
+        shadow_cache_init(cache_system->shadow,
+                          cache_system->num_sets * cache_system->associativity);
+    }
+}
+
+void cache_system_enable_set_profile(struct cache_system *cache_system)
+{
+    if (cache_system->profile == NULL) {
+        cache_system->profile = malloc(sizeof(struct set_profile));
+        set_profile_init(cache_system->profile, cache_system->num_sets);
+    }
+}
+
+void cache_system_reset_stats(struct cache_system *cache_system)
+{
+    memset(&cache_system->stats, 0, sizeof(cache_system->stats));
+    memset(cache_system->recent_misses, 0, sizeof(cache_system->recent_misses));
+    if (cache_system->profile) set_profile_reset(cache_system->profile);
+}
+
+void cache_system_enable_prefetch_filter(struct cache_system *cache_system)
+{
+    if (cache_system->prefetch_queue == NULL) {
+        cache_system->prefetch_queue = calloc(1, sizeof(struct prefetch_queue));
+    }
+}
+
+// Snapshots
+// ============================================================================
+// The line arrays are written as they are. The prefetch queue is always empty
+// between accesses, so only the filter's table of recent prefetches is saved.
+int cache_system_save(struct cache_system *cache_system, struct checkpoint *checkpoint)
+{
+    size_t num_lines = (size_t)cache_system->num_sets * cache_system->associativity;
+    checkpoint_write(checkpoint, &cache_system->stats, sizeof(cache_system->stats));
+    checkpoint_write(checkpoint, cache_system->tags, num_lines * sizeof(uint32_t));
+    uint8_t has_tags_high = cache_system->tags_high != NULL;
+    checkpoint_write(checkpoint, &has_tags_high, sizeof(has_tags_high));
+    checkpoint_write(checkpoint, &cache_system->tag_high_base, sizeof(cache_system->tag_high_base));
+    checkpoint_write(checkpoint, &cache_system->has_tag_high_base,
+                     sizeof(cache_system->has_tag_high_base));
+    if (has_tags_high) {
+        checkpoint_write(checkpoint, cache_system->tags_high, num_lines * sizeof(uint32_t));
+    }
+    checkpoint_write(checkpoint, cache_system->statuses, num_lines);
+    checkpoint_write(checkpoint, cache_system->prefetched, num_lines);
+    line_set_save(&cache_system->accessed_lines, checkpoint);
+    checkpoint_write(checkpoint, cache_system->recent_misses, sizeof(cache_system->recent_misses));
+
+    uint8_t has_filter = cache_system->prefetch_queue != NULL;
+    checkpoint_write(checkpoint, &has_filter, sizeof(has_filter));
+    if (has_filter) {
+        checkpoint_write(checkpoint, cache_system->prefetch_queue->recent,
+                         sizeof(cache_system->prefetch_queue->recent));
+    }
+    uint8_t has_shadow = cache_system->shadow != NULL;
+    checkpoint_write(checkpoint, &has_shadow, sizeof(has_shadow));
+    if (has_shadow) shadow_cache_save(cache_system->shadow, checkpoint);
+
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+    if (replacement_policy->save) {
+        (*replacement_policy->save)(replacement_policy, cache_system, checkpoint);
+    }
+    struct prefetcher *prefetcher = cache_system->prefetcher;
+    if (prefetcher->save) (*prefetcher->save)(prefetcher, cache_system, checkpoint);
+    return checkpoint_status(checkpoint);
+}
+
+int cache_system_load(struct cache_system *cache_system, struct checkpoint *checkpoint)
+{
+    size_t num_lines = (size_t)cache_system->num_sets * cache_system->associativity;
+    checkpoint_read(checkpoint, &cache_system->stats, sizeof(cache_system->stats));
+    checkpoint_read(checkpoint, cache_system->tags, num_lines * sizeof(uint32_t));
+    uint8_t has_tags_high = 0;
+    checkpoint_read(checkpoint, &has_tags_high, sizeof(has_tags_high));
+    checkpoint_read(checkpoint, &cache_system->tag_high_base, sizeof(cache_system->tag_high_base));
+    checkpoint_read(checkpoint, &cache_system->has_tag_high_base,
+                    sizeof(cache_system->has_tag_high_base));
+    if (has_tags_high) {
+        if (cache_system->tags_high == NULL) cache_system_widen_tags(cache_system);
+        checkpoint_read(checkpoint, cache_system->tags_high, num_lines * sizeof(uint32_t));
+    }
+    checkpoint_read(checkpoint, cache_system->statuses, num_lines);
+    checkpoint_read(checkpoint, cache_system->prefetched, num_lines);
+    if (line_set_load(&cache_system->accessed_lines, checkpoint) != 0) return 1;
+    checkpoint_read(checkpoint, cache_system->recent_misses, sizeof(cache_system->recent_misses));
+
+    uint8_t has_filter = 0;
+    checkpoint_read(checkpoint, &has_filter, sizeof(has_filter));
+    if (has_filter) {
+        cache_system_enable_prefetch_filter(cache_system);
+        checkpoint_read(checkpoint, cache_system->prefetch_queue->recent,
+                        sizeof(cache_system->prefetch_queue->recent));
+    }
+    uint8_t has_shadow = 0;
+    if (checkpoint_read(checkpoint, &has_shadow, sizeof(has_shadow)) != 0) return 1;
+    if (has_shadow) {
+        cache_system_enable_three_c(cache_system);
+        if (shadow_cache_load(cache_system->shadow, checkpoint) != 0) return 1;
+    }
+
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+    if (replacement_policy->load &&
+        (*replacement_policy->load)(replacement_policy, cache_system, checkpoint) != 0) {
+        return 1;
+    }
+    struct prefetcher *prefetcher = cache_system->prefetcher;
+    if (prefetcher->load && (*prefetcher->load)(prefetcher, cache_system, checkpoint) != 0) {
+        return 1;
+    }
+    return checkpoint_status(checkpoint);
+}
+
+int cache_system_prefetch(struct cache_system *cache_system, uint64_t address)
+{
+    // Count each recent miss at most once, however many prefetches hit it.
+    uint64_t line_id = address >> cache_system->offset_bits;
+    struct recent_miss *recent =
+        &cache_system->recent_misses[line_id & (PREFETCH_LATE_TABLE_SIZE - 1)];
+    if (recent->access != 0 && recent->line_id == line_id &&
+        cache_system->stats.accesses - recent->access <= PREFETCH_LATE_WINDOW) {
+        cache_system->stats.late_prefetches++;
+        recent->access = 0;
+    }
+
+    struct prefetch_queue *queue = cache_system->prefetch_queue;
+    if (queue == NULL) return cache_system_mem_access(cache_system, address, 'R', true);
+
+    if (queue->count == PREFETCH_QUEUE_SIZE) {
+        int status = cache_system_drain_prefetches(cache_system);
+        if (status != 0) return status;
+    }
+    queue->addresses[queue->count++] = address;
+    return 0;
+}
+
+// Carry out the queued prefetches, dropping the ones for lines that were
+// recently prefetched or are already in the cache.
+static int cache_system_drain_prefetches(struct cache_system *cache_system)
+{
+    struct prefetch_queue *queue = cache_system->prefetch_queue;
+    for (uint32_t i = 0; i < queue->count; i++) {
+        uint64_t address = queue->addresses[i];
+        uint64_t line_id = address >> cache_system->offset_bits;
+        uint64_t *recent = &queue->recent[line_id & (PREFETCH_FILTER_SIZE - 1)];
+        uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+        uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+
+        if (*recent == line_id + 1 || cache_system_find_way(cache_system, set_idx, tag) >= 0) {
+            trace_printf("  prefetch: 0x%llx filtered\n", (unsigned long long)address);
+            cache_system->stats.prefetches_filtered++;
+            continue;
+        }
+
+        *recent = line_id + 1;
+        if (cache_system_mem_access(cache_system, address, 'R', true) != 0) {
+            queue->count = 0;
+            return 1;
         }
-        current = current->next;
     }
-    return false; // If we got here, the ID we are looking for was not in the set.
+    queue->count = 0;
+    return 0;
 }
 
-struct cache_line *cache_system_find_cache_line(struct cache_system *cache_system, uint32_t set_idx,
-                                                uint32_t tag)
+bool cache_system_probe(struct cache_system *cache_system, uint64_t address)
 {
-    // TODO Return a pointer to the cache line within the given set that has
-    // the given tag. If no such element exists, then return NULL.
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    return cache_system_find_way(cache_system, set_idx, tag) >= 0;
+}
 
-    int32_t a = cache_system->associativity;
-    int s = set_idx * a;
-    for(int i=s;i<s+a;i++){
-        if (cache_system->cache_lines[i].tag == tag) {
-            return &cache_system->cache_lines[i];
-            }
+enum cache_status cache_system_line_status(struct cache_system *cache_system, uint64_t address)
+{
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    int way = cache_system_find_way(cache_system, set_idx, tag);
+    if (way < 0) return INVALID;
+    return cache_system->statuses[cache_system_line_index(cache_system, set_idx, way)];
+}
+
+void cache_system_set_line_status(struct cache_system *cache_system, uint64_t address,
+                                  enum cache_status status)
+{
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    int way = cache_system_find_way(cache_system, set_idx, tag);
+    if (way >= 0) cache_system->statuses[cache_system_line_index(cache_system, set_idx, way)] = status;
+}
+
+bool cache_system_invalidate(struct cache_system *cache_system, uint64_t address, bool *dirty)
+{
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    int way = cache_system_find_way(cache_system, set_idx, tag);
+    if (way < 0) return false;
+
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+    if (replacement_policy->evict) {
+        (*replacement_policy->evict)(replacement_policy, cache_system, set_idx, way);
+    }
+
+    uint32_t index = cache_system_line_index(cache_system, set_idx, way);
+    trace_printf("  invalidate %s cache line in set %d index %d\n",
+                 (cache_system->statuses[index] == MODIFIED ? "dirty" : "clean"), set_idx, way);
+    if (dirty) *dirty = cache_system->statuses[index] == MODIFIED;
+    cache_system->statuses[index] = INVALID;
+    cache_system->prefetched[index] = false;
+    return true;
+}
+
+int cache_system_install(struct cache_system *cache_system, uint64_t address, bool dirty)
+{
+    uint32_t set_idx = (address & cache_system->set_index_mask) >> cache_system->offset_bits;
+    uint64_t tag = address >> (cache_system->offset_bits + cache_system->index_bits);
+    uint32_t set_start = cache_system_line_index(cache_system, set_idx, 0);
+    struct replacement_policy *replacement_policy = cache_system->replacement_policy;
+
+    int way = cache_system_find_way(cache_system, set_idx, tag);
+    if (way >= 0) {
+        if (dirty) cache_system->statuses[set_start + way] = MODIFIED;
+        return 0;
+    }
+
+    way = cache_system_make_room(cache_system, set_idx, false, dirty ? CACHE_EVENT_FLAG_WRITE : 0);
+    if (way < 0) return 1;
+    trace_printf("  install cache line with tag 0x%llx in set %d index %d\n",
+                 (unsigned long long)tag, set_idx, way);
+    cache_system_set_tag(cache_system, set_start + way, tag);
+    cache_system->statuses[set_start + way] = dirty ? MODIFIED : EXCLUSIVE;
+    cache_system->prefetched[set_start + way] = false;
+
+    char rw = dirty ? 'W' : 'R';
+    if (replacement_policy->fill) {
+        (*replacement_policy->fill)(replacement_policy, cache_system, set_idx, way, rw);
+    }
+    if (replacement_policy->access) {
+        (*replacement_policy->access)(replacement_policy, cache_system, set_idx, way, false, rw);
+    }
+    return 0;
+}
+
+void cache_system_line_id_add(struct cache_system *cache_system, uint64_t line_id)
+{
+    line_set_insert(&cache_system->accessed_lines, line_id);
+}
+
+bool cache_system_line_in_accessed_set(struct cache_system *cache_system, uint64_t line_id)
+{
+    return line_set_contains(&cache_system->accessed_lines, line_id);
+}
+
+void cache_system_widen_tags(struct cache_system *cache_system)
+{
+    size_t num_lines = (size_t)cache_system->num_sets * cache_system->associativity;
+    cache_system->tags_high = malloc(num_lines * sizeof(uint32_t));
+    for (size_t i = 0; i < num_lines; i++) {
+        cache_system->tags_high[i] = cache_system->tag_high_base;
+    }
+}
+
+// Given a bitmask of the ways starting at first whose low tag words match,
+// returns the first of them that holds a valid line with the same high tag
+// word, or -1. tags_high is NULL if every line's high tag word is known to
+// match.
+static inline int first_valid_match(const uint8_t *statuses, const uint32_t *tags_high,
+                                    uint32_t tag_high, uint32_t first, uint32_t matches)
+{
+    while (matches) {
+        int way = first + __builtin_ctz(matches);
+        if (statuses[way] != INVALID && (tags_high == NULL || tags_high[way] == tag_high)) {
+            return way;
         }
-  	return NULL;
-}
\ No newline at end of file
+        matches &= matches - 1;
+    }
+    return -1;
+}
+
+int cache_system_find_way(struct cache_system *cache_system, uint32_t set_idx, uint64_t tag)
+{
+    uint32_t set_start = cache_system_line_index(cache_system, set_idx, 0);
+    const uint32_t *tags = &cache_system->tags[set_start];
+    const uint8_t *statuses = &cache_system->statuses[set_start];
+    uint32_t associativity = cache_system->associativity;
+    uint32_t tag_low = (uint32_t)tag, tag_high = (uint32_t)(tag >> 32);
+    uint32_t i = 0;
+
+    // Without per-line high tag words, every line has the base ones.
+    const uint32_t *tags_high = NULL;
+    if (cache_system->tags_high) {
+        tags_high = &cache_system->tags_high[set_start];
+    } else if (tag_high != cache_system->tag_high_base) {
+        return -1;
+    }
+
+    // Compare as many low tag words at a time as the vector width allows.
+    // Invalid lines can hold stale tags, so a match only counts if the line is
+    // valid (and its high tag word matches too).
+#if defined(__AVX2__)
+    __m256i needle8 = _mm256_set1_epi32(tag_low);
+    for (; i + 8 <= associativity; i += 8) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)&tags[i]);
+        uint32_t matches =
+            _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(chunk, needle8)));
+        int way = matches ? first_valid_match(statuses, tags_high, tag_high, i, matches) : -1;
+        if (way >= 0) return way;
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i needle4 = _mm_set1_epi32(tag_low);
+    for (; i + 4 <= associativity; i += 4) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)&tags[i]);
+        uint32_t matches = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(chunk, needle4)));
+        int way = matches ? first_valid_match(statuses, tags_high, tag_high, i, matches) : -1;
+        if (way >= 0) return way;
+    }
+#endif
+
+    // Scalar fallback, and the remaining ways.
+    for (; i < associativity; i++) {
+        if (tags[i] == tag_low && statuses[i] != INVALID &&
+            (tags_high == NULL || tags_high[i] == tag_high)) {
+            return i;
+        }
+    }
+    return -1;
+}
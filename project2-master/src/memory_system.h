@@ -15,39 +15,97 @@
 
 struct replacement_policy;
 struct prefetcher;
+struct checkpoint;
+#include "line_set.h"
+#include "logging.h"
 #include "prefetchers.h"
 #include "replacement_policies.h"
+#include "set_profile.h"
+#include "shadow_cache.h"
 
-#define ACCESSED_HASHTABLE_SIZE 4096
+#define ACCESSED_LINES_INITIAL_CAPACITY 4096
+#define PREFETCH_QUEUE_SIZE 64
+#define PREFETCH_FILTER_SIZE 64 // Must be a power of two
+#define PREFETCH_LATE_TABLE_SIZE 64 // Must be a power of two
+#define PREFETCH_LATE_WINDOW 16     // Demand accesses after a miss that a prefetch is late by
+#define CACHE_SYSTEM_FILL_DROPPED -1
+#define CACHE_SYSTEM_BATCH_CHUNK 256 // Accesses whose set and tag are computed at once
 
 // This struct contains statistics about the cache performance.
 struct cache_system_stats {
-    uint32_t accesses;          // Total number of cache accesses
-    uint32_t hits;              // Total number of cache hits
-    uint32_t misses;            // Total number of cache misses
-    uint32_t prefetches;        // Total number of prefetched cache lines
-    uint32_t compulsory_misses; // Total number of compulsory misses
-    uint32_t conflict_misses;   // Total number of conflict misses
-    uint32_t dirty_evictions;   // Total number of cache evictions requiring write-back
+    uint64_t accesses;          // Total number of cache accesses
+    uint64_t hits;              // Total number of cache hits
+    uint64_t misses;            // Total number of cache misses
+    uint64_t prefetches;        // Total number of prefetched cache lines (as issued by the
+                                // prefetcher)
+    uint64_t compulsory_misses; // Total number of compulsory misses
+    uint64_t conflict_misses;   // Total number of conflict misses
+    uint64_t capacity_misses;   // Misses a fully-associative cache would also have had (only
+                                // counted with three-C classification, and then not included
+                                // in conflict_misses)
+    uint64_t dirty_evictions;   // Total number of cache evictions requiring write-back
+    uint64_t prefetches_filtered; // Prefetches dropped by the prefetch filter
+    uint64_t prefetches_filled;   // Prefetches that brought a line into the cache
+    uint64_t useful_prefetches;   // Prefetched lines that were then hit by a demand access
+    uint64_t useless_prefetches;  // Prefetched lines that were evicted before any demand access
+    uint64_t pollution_evictions; // Lines evicted by a prefetch fill that were not themselves
+                                  // unused prefetches
+    uint64_t late_prefetches;     // Prefetches requested for a line that had a demand miss in
+                                  // the last PREFETCH_LATE_WINDOW demand accesses
+};
+
+// The pending prefetches of a cache system with the prefetch filter enabled.
+// Prefetchers add requests with cache_system_prefetch, and they are carried
+// out once the prefetcher returns. A request is dropped without touching its
+// set if the line was recently prefetched (according to a small direct-mapped
+// table of line IDs) or is already in the cache.
+struct prefetch_queue {
+    uint64_t addresses[PREFETCH_QUEUE_SIZE];
+    uint32_t count;
+    uint64_t recent[PREFETCH_FILTER_SIZE]; // line ID + 1, or 0 if empty
+};
+
+// A recent demand miss, remembered to find late prefetches. There is no
+// timing model, so a prefetch can never arrive too late; instead, one that is
+// requested just after a demand miss on its line stands for a prefetch that
+// had the right line but came too late to help.
+struct recent_miss {
+    uint64_t line_id;
+    uint64_t access; // The number of the demand access that missed, or 0 if empty
+};
+
+// Lets a cache system be chained to the next level of a hierarchy (see
+// hierarchy.h). Both functions return non-zero on error.
+struct cache_system_listener {
+    // Called on every miss (including prefetch misses), before a way is chosen
+    // for the line, to fetch the line from the next level. *status is the
+    // status the line will be stored with (MODIFIED for writes and EXCLUSIVE
+    // for reads) and may be changed, e.g. to MODIFIED if the line arrives
+    // dirty. For prefetches, returning CACHE_SYSTEM_FILL_DROPPED cancels the
+    // prefetch.
+    int (*fill)(struct cache_system_listener *listener, struct cache_system *cache_system,
+                uint64_t address, bool is_prefetch, uint8_t *status);
+
+    // Called when a valid line is evicted to make room for another line, with
+    // the address of the start of the evicted line.
+    int (*evict)(struct cache_system_listener *listener, struct cache_system *cache_system,
+                 uint64_t address, bool dirty);
+
+    // Optional. Called when a write hits a SHARED line, before the line
+    // becomes MODIFIED.
+    int (*upgrade)(struct cache_system_listener *listener, struct cache_system *cache_system,
+                   uint64_t address);
+
+    void *data;
 };
 
 // This enum keeps track of the status of each cache line in a set.
 enum cache_status {
     INVALID,   // The cache line is invalid.
-    EXCLUSIVE, // The cache line is valid, and held exclusively by the current processor (no
-               // multi-processors).
+    EXCLUSIVE, // The cache line is valid, and held exclusively by the current processor.
     MODIFIED,  // The cache line is valid, and modified (requires write-back).
-};
-struct cache_line {
-    uint32_t tag;
-    enum cache_status status;
-};
-
-// This is a linked list struct for the hash table to keep track of what lines
-// have been accessed.
-struct accessed_line {
-    uint32_t line_id;
-    struct accessed_line *next;
+    SHARED,    // The cache line is valid and clean, and other processors may hold it too
+               // (only used by the multi-core simulation, see coherence.h).
 };
 
 // This struct contains the data related to a cache system.
@@ -59,30 +117,161 @@ struct cache_system {
     // The cache state
     uint32_t line_size, num_sets, associativity;
     uint32_t index_bits, tag_bits, offset_bits;
-    struct cache_line *cache_lines; // Storing the cache lines in a flat array.
+
+    // The cache lines, stored as separate flat arrays of tags and statuses so
+    // that the tags of a set are contiguous and can be compared several at a
+    // time. Way w of set s is at index s * associativity + w (see
+    // cache_system_line_index).
+    //
+    // Tags are up to 64 bits wide, but only their low 32 bits are searched.
+    // The high bits are usually the same for every line, so they are kept once
+    // in tag_high_base; tags_high is only allocated (see
+    // cache_system_widen_tags) once a tag with other high bits is stored, and
+    // then holds the high bits of each line, checked on a low-bits match.
+    uint32_t *tags;      // The low 32 bits of each tag
+    uint32_t *tags_high; // The high 32 bits of each tag, or NULL if they are all tag_high_base
+    uint32_t tag_high_base;
+    bool has_tag_high_base; // Whether a tag has been stored yet, fixing tag_high_base
+    uint8_t *statuses;   // enum cache_status values
+    uint8_t *prefetched; // Whether the line was prefetched and has not been used since
 
     // Masks and shifts
-    uint32_t offset_mask, set_index_mask;
+    uint64_t offset_mask, set_index_mask;
+
+    // The IDs of every line that has ever been accessed.
+    struct line_set accessed_lines;
+
+    // The latest demand misses, in a direct-mapped table indexed by line ID.
+    struct recent_miss recent_misses[PREFETCH_LATE_TABLE_SIZE];
+
+    // If not NULL, every hit, miss, eviction and fill is recorded here.
+    struct event_sink *events;
+
+    // If not NULL, prefetches are queued and filtered (see prefetch_queue).
+    struct prefetch_queue *prefetch_queue;
 
-    // Store the hash table as an array of linked lists.
-    struct accessed_line **accessed_lines_hashtable;
+    // If not NULL, told about every miss and eviction.
+    struct cache_system_listener *listener;
+
+    // If not NULL, sees every demand access, and misses are classified as
+    // compulsory, capacity or conflict misses (see shadow_cache.h).
+    struct shadow_cache *shadow;
+
+    // If not NULL, the accesses, misses and evictions of each set are counted
+    // here (see set_profile.h).
+    struct set_profile *profile;
 };
 
 // Create a new cache system.
 struct cache_system *cache_system_new(uint32_t line_size, uint32_t sets, uint32_t associativity);
 void cache_system_cleanup(struct cache_system *cache_system);
 
+// Attach a replacement policy to the cache system. The cache system takes
+// ownership of the policy. Version 1 policies are adapted to version 2 here.
+void cache_system_set_replacement_policy(struct cache_system *cache_system,
+                                         struct replacement_policy *replacement_policy);
+
 // Perform updates to access memory
-int cache_system_mem_access(struct cache_system *cache_system, uint32_t address, char rw,
+int cache_system_mem_access(struct cache_system *cache_system, uint64_t address, char rw,
                             bool is_prefetch);
 
+// Perform the demand accesses addresses[i] (a read if rws[i] is 'R' and a
+// write if it is 'W') in order. The result is the same as calling
+// cache_system_mem_access for each of them, including the trace output, which
+// prints each access before performing it. Returns non-zero on error.
+int cache_system_mem_access_batch(struct cache_system *cache_system, const uint64_t *addresses,
+                                  const char *rws, size_t count);
+
+// Prefetch the line containing the given address. Prefetchers should use this
+// rather than calling cache_system_mem_access directly. Without the prefetch
+// filter, this is the same as a prefetch cache_system_mem_access.
+int cache_system_prefetch(struct cache_system *cache_system, uint64_t address);
+
+// Queue and filter the prefetches of this cache system from now on.
+void cache_system_enable_prefetch_filter(struct cache_system *cache_system);
+
+// Separate the capacity misses from the conflict misses from now on, by
+// running a fully-associative LRU cache of the same size alongside this one.
+void cache_system_enable_three_c(struct cache_system *cache_system);
+
+// Count the accesses, misses and evictions of each set from now on.
+void cache_system_enable_set_profile(struct cache_system *cache_system);
+
+// Start counting from zero, e.g. at the end of a warmup: clears the
+// statistics, the per-set profile and the recent misses (whose access numbers
+// refer to the old count). The cache contents are kept.
+void cache_system_reset_stats(struct cache_system *cache_system);
+
+// Write the state of the cache system (its statistics, lines, accessed lines,
+// recent misses, prefetch filter, shadow cache, replacement policy and
+// prefetcher) to a snapshot, or restore it from one (see checkpoint.h). The
+// cache system being restored must have the same geometry, replacement policy
+// and prefetcher as the one that was saved; the prefetch filter and three-C
+// classification are enabled if they were enabled in the saved one. The event
+// log, listener and set profile are not part of the state. Return 0 on
+// success.
+int cache_system_save(struct cache_system *cache_system, struct checkpoint *checkpoint);
+int cache_system_load(struct cache_system *cache_system, struct checkpoint *checkpoint);
+
+// Primitives for managing lines directly, without counting them as accesses.
+// These are used by the cache hierarchy.
+//
+// cache_system_probe returns whether the line containing the address is in
+// the cache, and cache_system_line_status returns its status (INVALID if it is
+// not in the cache). cache_system_set_line_status changes the status of a line
+// that is in the cache to another valid status. cache_system_invalidate removes it, returning whether it was in
+// the cache and setting *dirty (if not NULL) to whether it was modified.
+// cache_system_install stores the line (evicting another if necessary) or, if
+// it is already there, marks it modified if dirty is set. It returns non-zero
+// on error.
+bool cache_system_probe(struct cache_system *cache_system, uint64_t address);
+enum cache_status cache_system_line_status(struct cache_system *cache_system, uint64_t address);
+bool cache_system_invalidate(struct cache_system *cache_system, uint64_t address, bool *dirty);
+void cache_system_set_line_status(struct cache_system *cache_system, uint64_t address,
+                                  enum cache_status status);
+int cache_system_install(struct cache_system *cache_system, uint64_t address, bool dirty);
+
 // Determine if a cache line has been accessed before.
-void cache_system_line_id_add(struct cache_system *cache_system, uint32_t line_id);
-bool cache_system_line_in_accessed_set(struct cache_system *cache_system, uint32_t line_id);
+void cache_system_line_id_add(struct cache_system *cache_system, uint64_t line_id);
+bool cache_system_line_in_accessed_set(struct cache_system *cache_system, uint64_t line_id);
+
+// Returns the way within the given set that holds a valid line with the given
+// tag, or -1 if there is no such line. This uses SSE2 or AVX2 when available.
+int cache_system_find_way(struct cache_system *cache_system, uint32_t set_idx, uint64_t tag);
+
+// The index of the given way of the given set in the tags and statuses arrays.
+static inline uint32_t cache_system_line_index(struct cache_system *cache_system, uint32_t set_idx,
+                                               uint32_t way)
+{
+    return set_idx * cache_system->associativity + way;
+}
+
+// Allocates tags_high, filling it with tag_high_base. This is called the first
+// time a tag whose high bits differ from tag_high_base is stored.
+void cache_system_widen_tags(struct cache_system *cache_system);
+
+// The full tag of the line at the given index.
+static inline uint64_t cache_system_tag(struct cache_system *cache_system, uint32_t index)
+{
+    uint32_t high = cache_system->tags_high ? cache_system->tags_high[index]
+                                            : cache_system->tag_high_base;
+    return ((uint64_t)high << 32) | cache_system->tags[index];
+}
 
-// Returns a pointer to the cache line within the given set that has the given
-// tag. If no such element exists, then return NULL.
-struct cache_line *cache_system_find_cache_line(struct cache_system *cache_system, uint32_t set_idx,
-                                                uint32_t tag);
+static inline void cache_system_set_tag(struct cache_system *cache_system, uint32_t index,
+                                        uint64_t tag)
+{
+    uint32_t high = (uint32_t)(tag >> 32);
+    cache_system->tags[index] = (uint32_t)tag;
+    if (cache_system->tags_high == NULL) {
+        if (!cache_system->has_tag_high_base) {
+            cache_system->tag_high_base = high;
+            cache_system->has_tag_high_base = true;
+        }
+        if (high == cache_system->tag_high_base) return;
+        cache_system_widen_tags(cache_system);
+    }
+    cache_system->tags_high[index] = high;
+}
 
 #endif
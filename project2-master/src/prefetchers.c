@@ -5,10 +5,12 @@
 
 #include "prefetchers.h"
 
+#include "checkpoint.h"
+
 // Null Prefetcher
 // ============================================================================
 uint32_t null_handle_mem_access(struct prefetcher *prefetcher, struct cache_system *cache_system,
-                                uint32_t address, bool is_miss)
+                                uint64_t address, bool is_miss)
 {
     return 0; // No lines prefetched
 }
@@ -32,14 +34,14 @@ struct sequential_data {
 };
 
 uint32_t sequential_handle_mem_access(struct prefetcher *prefetcher,
-                                      struct cache_system *cache_system, uint32_t address,
+                                      struct cache_system *cache_system, uint64_t address,
                                       bool is_miss)
 {
     // TODO: Return the number of lines that were prefetched.
     if(((struct sequential_data*) prefetcher->data)->n > 0){
 	    for(int i = 1; i <= ((struct sequential_data*) prefetcher->data)->n; i++){
-		    uint32_t fetch_address = address + i*cache_system->line_size;
-    		cache_system_mem_access(cache_system, fetch_address, 'R', true);
+		    uint64_t fetch_address = address + i*cache_system->line_size;
+    		cache_system_prefetch(cache_system, fetch_address);
 	    }
     }
     return ((struct sequential_data*) prefetcher->data)->n;;
@@ -71,14 +73,14 @@ struct prefetcher *sequential_prefetcher_new(uint32_t prefetch_amount)
 // Adjacent Prefetcher
 // ============================================================================
 uint32_t adjacent_handle_mem_access(struct prefetcher *prefetcher,
-                                    struct cache_system *cache_system, uint32_t address,
+                                    struct cache_system *cache_system, uint64_t address,
                                     bool is_miss)
 {
     // TODO perform the necessary prefetches for the adjacent strategy.
     
     // TODO: Return the number of lines that were prefetched.
-    uint32_t prefetch_address = address + cache_system->line_size;
-    cache_system_mem_access(cache_system, prefetch_address, 'R', true);
+    uint64_t prefetch_address = address + cache_system->line_size;
+    cache_system_prefetch(cache_system, prefetch_address);
     return 1; 
 }
 
@@ -103,54 +105,155 @@ struct prefetcher *adjacent_prefetcher_new()
 
 // Custom Prefetcher
 // ============================================================================
+// A reference prediction table without program counters: streams are told
+// apart by the address region they touch instead of by the instruction that
+// makes the accesses. Each region gets an entry in a direct-mapped table that
+// learns the stride (in cache lines) between the demand accesses to it, using
+// the four states of Chen and Baer's reference prediction table:
+//
+//      INITIAL   --match-->   STEADY   <--match--   TRANSIENT
+//      INITIAL   --miss--->   TRANSIENT (new stride)
+//      TRANSIENT --miss--->   NO_PREDICTION (new stride)
+//      STEADY    --miss--->   INITIAL (stride kept)
+//      NO_PREDICTION --match--> TRANSIENT, --miss--> NO_PREDICTION (new stride)
+//
+// Only STEADY entries prefetch, so a stride has to be confirmed before any
+// line is fetched. A STEADY entry with stride s at line L prefetches the lines
+// L + s * distance, ..., L + s * (distance + degree - 1), where the degree
+// grows with the number of consecutive confirmations up to the configured
+// degree. Lines that an entry already prefetched are not prefetched again.
+#define CUSTOM_TABLE_BITS 8
+#define CUSTOM_TABLE_ENTRIES (1 << CUSTOM_TABLE_BITS)
+#define CUSTOM_REGION_BITS 12 // 4 KiB regions
+
+enum custom_stream_state {
+    CUSTOM_STREAM_INITIAL,
+    CUSTOM_STREAM_TRANSIENT,
+    CUSTOM_STREAM_STEADY,
+    CUSTOM_STREAM_NO_PREDICTION,
+};
+
+struct custom_stream {
+    uint64_t region;         // The region tag
+    uint64_t last_line;      // The line of the last demand access to the region
+    uint64_t last_prefetch;  // The furthest line prefetched since becoming STEADY
+    int32_t stride;          // In lines
+    uint8_t confidence;      // Consecutive confirmations of the stride
+    uint8_t state;           // enum custom_stream_state
+    bool valid;
+};
+
 struct custom_prefetch_data {
-    int32_t last_address;
-    int32_t last_stride;
-    int valid;  // Indicates if the last_stride is valid
+    struct custom_stream table[CUSTOM_TABLE_ENTRIES];
+    uint32_t degree, distance;
 };
 
+static inline uint32_t custom_table_index(uint64_t region)
+{
+    return (region * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - CUSTOM_TABLE_BITS);
+}
 
 uint32_t custom_handle_mem_access(struct prefetcher *prefetcher, struct cache_system *cache_system,
-                                  uint32_t address, bool is_miss) {
+                                  uint64_t address, bool is_miss)
+{
     struct custom_prefetch_data *data = (struct custom_prefetch_data *)prefetcher->data;
-    if (is_miss) {
-        if (data->valid) {
-            int32_t current_stride = address - data->last_address;
-            uint32_t prefetch_address = address + data->last_stride;
-            cache_system_mem_access(cache_system, prefetch_address, 'R', true);
-            data->last_stride = current_stride;
+    uint64_t line = address >> cache_system->offset_bits;
+    uint64_t region = address >> CUSTOM_REGION_BITS;
+    struct custom_stream *stream = &data->table[custom_table_index(region)];
+
+    // Allocate (or steal) the entry for a region that is not in the table.
+    if (!stream->valid || stream->region != region) {
+        stream->valid = true;
+        stream->region = region;
+        stream->last_line = line;
+        stream->stride = 0;
+        stream->confidence = 0;
+        stream->state = CUSTOM_STREAM_INITIAL;
+        return 0;
+    }
+
+    // Accesses within the same line say nothing about the stride.
+    int32_t stride = (int32_t)(int64_t)(line - stream->last_line);
+    if (stride == 0) return 0;
+    stream->last_line = line;
+
+    bool match = stride == stream->stride;
+    switch (stream->state) {
+    case CUSTOM_STREAM_INITIAL:
+    case CUSTOM_STREAM_TRANSIENT:
+        if (match) {
+            stream->state = CUSTOM_STREAM_STEADY;
+            stream->last_prefetch = line;
+        } else {
+            stream->state = stream->state == CUSTOM_STREAM_INITIAL ? CUSTOM_STREAM_TRANSIENT
+                                                                    : CUSTOM_STREAM_NO_PREDICTION;
+            stream->stride = stride;
+        }
+        break;
+    case CUSTOM_STREAM_STEADY:
+        if (!match) stream->state = CUSTOM_STREAM_INITIAL;
+        break;
+    case CUSTOM_STREAM_NO_PREDICTION:
+        if (match) {
+            stream->state = CUSTOM_STREAM_TRANSIENT;
         } else {
-            data->valid = 1;
+            stream->stride = stride;
         }
+        break;
+    }
 
-        data->last_address = address;
-        return 1;  // One line prefetched
+    if (stream->state != CUSTOM_STREAM_STEADY) {
+        stream->confidence = 0;
+        return 0;
     }
-    return 0;  // No prefetch occurs if there is no cache miss
+    if (stream->confidence < UINT8_MAX) stream->confidence++;
+
+    // Prefetch ahead of the stream, skipping the lines that are already done.
+    uint32_t degree = stream->confidence < data->degree ? stream->confidence : data->degree;
+    uint32_t prefetched = 0;
+    for (uint32_t i = 0; i < degree; i++) {
+        uint64_t target = line + (uint64_t)((int64_t)stream->stride * (data->distance + i));
+        int64_t ahead = (int64_t)(target - stream->last_prefetch);
+        if ((stream->stride > 0) ? ahead <= 0 : ahead >= 0) continue;
+
+        cache_system_prefetch(cache_system, target << cache_system->offset_bits);
+        stream->last_prefetch = target;
+        prefetched++;
+    }
+    return prefetched;
 }
 
+int custom_save(struct prefetcher *prefetcher, struct cache_system *cache_system,
+                struct checkpoint *checkpoint)
+{
+    struct custom_prefetch_data *data = (struct custom_prefetch_data *)prefetcher->data;
+    return checkpoint_write(checkpoint, data->table, sizeof(data->table));
+}
+
+int custom_load(struct prefetcher *prefetcher, struct cache_system *cache_system,
+                struct checkpoint *checkpoint)
+{
+    struct custom_prefetch_data *data = (struct custom_prefetch_data *)prefetcher->data;
+    return checkpoint_read(checkpoint, data->table, sizeof(data->table));
+}
 
 void custom_cleanup(struct prefetcher *prefetcher)
 {
-    // TODO cleanup any additional memory that you allocated in the
-    // custom_prefetcher_new function.
     free(prefetcher->data);
 }
 
-struct prefetcher *custom_prefetcher_new() {
+struct prefetcher *custom_prefetcher_new(uint32_t degree, uint32_t distance)
+{
     struct prefetcher *custom_prefetcher = calloc(1, sizeof(struct prefetcher));
     struct custom_prefetch_data *data = calloc(1, sizeof(struct custom_prefetch_data));
-
-    data->last_address = 0;
-    data->last_stride = 0;
-    data->valid = 0;
+    data->degree = degree > 0 ? degree : 1;
+    data->distance = distance > 0 ? distance : 1;
 
     custom_prefetcher->data = data;
     custom_prefetcher->handle_mem_access = &custom_handle_mem_access;
+    custom_prefetcher->save = &custom_save;
+    custom_prefetcher->load = &custom_load;
     custom_prefetcher->cleanup = &custom_cleanup;
 
     return custom_prefetcher;
 }
-
-
-
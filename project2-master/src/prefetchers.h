@@ -11,6 +11,7 @@
 #include <time.h>
 
 struct cache_system;
+struct checkpoint;
 #include "memory_system.h"
 
 // This struct describes the functionality of a prefetcher. The function
@@ -24,9 +25,11 @@ struct prefetcher {
     // This function allows the prefetcher to prefetch any lines it deems
     // necessary for the given memory access.
     //
-    // This function should call the cache_system_mem_access function to
-    // prefetch lines. It is important to pass `true` to the `is_prefetch`
-    // parameter so you don't end up in an infinite-prefetch loop.
+    // This function should call the cache_system_prefetch function to
+    // prefetch lines, which goes through the prefetch filter when it is
+    // enabled. (Calling cache_system_mem_access directly also works, but it
+    // is important to pass `true` to the `is_prefetch` parameter so you don't
+    // end up in an infinite-prefetch loop.)
     //
     // Arguments:
     //  * prefetcher: the instance of the prefetcher
@@ -36,7 +39,14 @@ struct prefetcher {
     //  * is_miss: whether the access was a miss
     // Returns: how many lines were prefetched (this requires).
     uint32_t (*handle_mem_access)(struct prefetcher *prefetcher, struct cache_system *cache_system,
-                                  uint32_t address, bool is_miss);
+                                  uint64_t address, bool is_miss);
+
+    // Optional, for prefetchers with state: write the state to a snapshot, or
+    // read it back (see checkpoint.h). Both return non-zero on error.
+    int (*save)(struct prefetcher *prefetcher, struct cache_system *cache_system,
+                struct checkpoint *checkpoint);
+    int (*load)(struct prefetcher *prefetcher, struct cache_system *cache_system,
+                struct checkpoint *checkpoint);
 
     // This function is called right before the prefetcher is deallocated. You
     // should perform any necessary cleanup operations here. (This is where you
@@ -54,6 +64,8 @@ struct prefetcher {
 struct prefetcher *null_prefetcher_new();
 struct prefetcher *adjacent_prefetcher_new();
 struct prefetcher *sequential_prefetcher_new(uint32_t prefetch_amount);
-struct prefetcher *custom_prefetcher_new();
+// The custom prefetcher issues up to degree lines per access to a confirmed
+// stream, starting distance strides ahead of it (both at least 1).
+struct prefetcher *custom_prefetcher_new(uint32_t degree, uint32_t distance);
 
 #endif
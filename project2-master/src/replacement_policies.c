@@ -15,120 +15,233 @@
 #include "replacement_policies.h"
 #include <time.h>
 #include <limits.h>
+#include <string.h>
 
-// LRU Replacement Policy
+#include "checkpoint.h"
+#include "rng.h"
+
+// Version 1 adapter
 // ============================================================================
-// TODO feel free to create additional structs/enums as necessary
+static void legacy_access(struct replacement_policy *replacement_policy,
+                          struct cache_system *cache_system, uint32_t set_idx, uint32_t way,
+                          bool is_hit, char rw)
+{
+    uint32_t index = cache_system_line_index(cache_system, set_idx, way);
+    uint64_t tag = cache_system_tag(cache_system, index);
+    (*replacement_policy->cache_access)(replacement_policy, cache_system, set_idx, tag);
+}
 
-struct lru_metadata {
-    uint32_t *last_access_times;
-    uint32_t access_counter;
-};
+void replacement_policy_adapt(struct replacement_policy *replacement_policy)
+{
+    if (replacement_policy->access == NULL && replacement_policy->cache_access != NULL) {
+        replacement_policy->access = &legacy_access;
+    }
+}
+
+// LRU recency lists
+// ============================================================================
+// Both LRU policies keep the ways of each set in a circular doubly linked list
+// ordered from most to least recently used. The links are way indices stored
+// in flat arrays (indexed like the cache lines), so touching a way and finding
+// the least recently used way are both O(1), and there is no access counter
+// that can wrap around.
+//
+// Every way is always in its set's list, so no sentinel is needed: the least
+// recently used way is the one before the head. The initial order does not
+// matter because every way is touched when it is first filled, and evictions
+// only happen once every way in the set has been filled.
+
+#define LRU_MAX_ASSOCIATIVITY 65536
 
+struct lru_list {
+    uint16_t *prev, *next; // per cache line: the neighbouring ways in its set
+    uint16_t *head;        // per set: the most recently used way
+    uint32_t associativity;
+};
 
-void lru_cache_access(struct replacement_policy *replacement_policy,
-                      struct cache_system *cache_system, uint32_t set_idx, uint32_t tag)
+static bool lru_list_init(struct lru_list *list, uint32_t sets, uint32_t associativity)
 {
-    // TODO update the LRU replacement policy state given a new memory access
-    struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
-    uint32_t set_base = set_idx * cache_system->associativity;
-    uint32_t access_time = ++metadata->access_counter;
+    if (associativity > LRU_MAX_ASSOCIATIVITY) {
+        fprintf(stderr, "LRU supports at most %d ways\n", LRU_MAX_ASSOCIATIVITY);
+        return false;
+    }
 
-    for (uint32_t i = 0; i < cache_system->associativity; ++i) {
-        struct cache_line *cl = &cache_system->cache_lines[set_base + i];
-        if (cl->tag == tag && cl->status != INVALID) {
-            metadata->last_access_times[set_base + i] = access_time;
-            break;
+    list->associativity = associativity;
+    list->prev = malloc(sets * associativity * sizeof(uint16_t));
+    list->next = malloc(sets * associativity * sizeof(uint16_t));
+    list->head = calloc(sets, sizeof(uint16_t));
+    for (uint32_t set = 0; set < sets; set++) {
+        uint32_t set_base = set * associativity;
+        for (uint32_t way = 0; way < associativity; way++) {
+            list->next[set_base + way] = (way + 1) % associativity;
+            list->prev[set_base + way] = (way + associativity - 1) % associativity;
         }
     }
+    return true;
+}
+
+static void lru_list_cleanup(struct lru_list *list)
+{
+    free(list->prev);
+    free(list->next);
+    free(list->head);
+}
+
+// Make the way the most recently used in its set.
+static inline void lru_list_touch(struct lru_list *list, uint32_t set_idx, uint32_t way)
+{
+    uint16_t head = list->head[set_idx];
+    if (head == way) return;
+
+    uint32_t set_base = set_idx * list->associativity;
+    uint16_t *prev = &list->prev[set_base], *next = &list->next[set_base];
+
+    // Unlink the way, then insert it in front of the head (i.e. between the
+    // least recently used way and the head).
+    next[prev[way]] = next[way];
+    prev[next[way]] = prev[way];
+
+    uint16_t tail = prev[head];
+    next[tail] = way;
+    prev[way] = tail;
+    next[way] = head;
+    prev[head] = way;
+    list->head[set_idx] = way;
+}
+
+static int lru_list_save(struct lru_list *list, uint32_t sets, struct checkpoint *checkpoint)
+{
+    size_t num_lines = (size_t)sets * list->associativity;
+    checkpoint_write(checkpoint, list->prev, num_lines * sizeof(uint16_t));
+    checkpoint_write(checkpoint, list->next, num_lines * sizeof(uint16_t));
+    return checkpoint_write(checkpoint, list->head, sets * sizeof(uint16_t));
+}
+
+static int lru_list_load(struct lru_list *list, uint32_t sets, struct checkpoint *checkpoint)
+{
+    size_t num_lines = (size_t)sets * list->associativity;
+    checkpoint_read(checkpoint, list->prev, num_lines * sizeof(uint16_t));
+    checkpoint_read(checkpoint, list->next, num_lines * sizeof(uint16_t));
+    return checkpoint_read(checkpoint, list->head, sets * sizeof(uint16_t));
+}
+
+static inline uint32_t lru_list_least_recent(struct lru_list *list, uint32_t set_idx)
+{
+    return list->prev[set_idx * list->associativity + list->head[set_idx]];
+}
+
+// LRU Replacement Policy
+// ============================================================================
+struct lru_metadata {
+    struct lru_list recency;
+};
+
+void lru_access(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                uint32_t set_idx, uint32_t way, bool is_hit, char rw)
+{
+    struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
+    lru_list_touch(&metadata->recency, set_idx, way);
 }
 
 uint32_t lru_eviction_index(struct replacement_policy *replacement_policy,
                             struct cache_system *cache_system, uint32_t set_idx)
 {
-    // TODO return the index within the set that should be evicted.
     struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
-    uint32_t set_base = set_idx * cache_system->associativity;
-    uint32_t least_recently_used = UINT32_MAX;
-    uint32_t lru_index = 0;
-
-    for (uint32_t i = 0; i < cache_system->associativity; ++i) {
-        uint32_t access_time = metadata->last_access_times[set_base + i];
-        if (access_time < least_recently_used) {
-            least_recently_used = access_time;
-            lru_index = i;
-        }
-    }
+    return lru_list_least_recent(&metadata->recency, set_idx);
+}
 
-    return lru_index;
+int lru_save(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+             struct checkpoint *checkpoint)
+{
+    struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
+    return lru_list_save(&metadata->recency, cache_system->num_sets, checkpoint);
+}
 
-    return 0;
+int lru_load(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+             struct checkpoint *checkpoint)
+{
+    struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
+    return lru_list_load(&metadata->recency, cache_system->num_sets, checkpoint);
 }
 
 void lru_replacement_policy_cleanup(struct replacement_policy *replacement_policy)
 {
-    // TODO cleanup any additional memory that you allocated in the
-    // lru_replacement_policy_new function.
     struct lru_metadata *metadata = (struct lru_metadata *)replacement_policy->data;
     if (metadata) {
-        free(metadata->last_access_times);
+        lru_list_cleanup(&metadata->recency);
         free(metadata);
     }
 }
 
 struct replacement_policy *lru_replacement_policy_new(uint32_t sets, uint32_t associativity)
 {
-    struct replacement_policy *lru_rp = calloc(1, sizeof(struct replacement_policy));
     struct lru_metadata *metadata = calloc(1, sizeof(struct lru_metadata));
+    if (!lru_list_init(&metadata->recency, sets, associativity)) {
+        free(metadata);
+        return NULL;
+    }
 
-    metadata->last_access_times = calloc(sets*associativity, sizeof(uint32_t));
-    metadata->access_counter = 0;
-
-    lru_rp->cache_access = &lru_cache_access;
+    struct replacement_policy *lru_rp = calloc(1, sizeof(struct replacement_policy));
+    lru_rp->access = &lru_access;
     lru_rp->eviction_index = &lru_eviction_index;
+    lru_rp->save = &lru_save;
+    lru_rp->load = &lru_load;
     lru_rp->cleanup = &lru_replacement_policy_cleanup;
     lru_rp->data = metadata;
 
-    // allocate any additional memory to store metadata here and assign to
-    // lru_rp->data.
-
     return lru_rp;
 }
 
 // RAND Replacement Policy
 // ============================================================================
-void rand_cache_access(struct replacement_policy *replacement_policy,
-                       struct cache_system *cache_system, uint32_t set_idx, uint32_t tag)
-{
-    // TODO update the RAND replacement policy state given a new memory access
-}
+struct rand_metadata {
+    struct rng rng;
+};
 
 uint32_t rand_eviction_index(struct replacement_policy *replacement_policy,
                              struct cache_system *cache_system, uint32_t set_idx)
 {
     // TODO return the index within the set that should be evicted.
+    struct rand_metadata *metadata = (struct rand_metadata *)replacement_policy->data;
+    return rng_below(&metadata->rng, cache_system->associativity);
+}
 
-    return rand() % cache_system->associativity;;
+int rand_save(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct rand_metadata *metadata = (struct rand_metadata *)replacement_policy->data;
+    return checkpoint_write(checkpoint, &metadata->rng, sizeof(metadata->rng));
+}
+
+int rand_load(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct rand_metadata *metadata = (struct rand_metadata *)replacement_policy->data;
+    return checkpoint_read(checkpoint, &metadata->rng, sizeof(metadata->rng));
 }
 
 void rand_replacement_policy_cleanup(struct replacement_policy *replacement_policy)
 {
     // TODO cleanup any additional memory that you allocated in the
     // rand_replacement_policy_new function.
+    free(replacement_policy->data);
 }
 
-struct replacement_policy *rand_replacement_policy_new(uint32_t sets, uint32_t associativity)
+struct replacement_policy *rand_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                       uint64_t seed)
 {
-    // Seed randomness
-    srand(time(NULL));
-
-    struct replacement_policy *rand_rp = malloc(sizeof(struct replacement_policy));
-    rand_rp->cache_access = &rand_cache_access;
+    struct replacement_policy *rand_rp = calloc(1, sizeof(struct replacement_policy));
+    // RAND keeps no state about accesses, so it has no access hooks at all.
     rand_rp->eviction_index = &rand_eviction_index;
+    rand_rp->save = &rand_save;
+    rand_rp->load = &rand_load;
     rand_rp->cleanup = &rand_replacement_policy_cleanup;
 
-    // TODO allocate any additional memory to store metadata here and assign to
-    // rand_rp->data.
+    // Each instance has its own generator, so that runs are reproducible and
+    // independent of any other cache systems in the process.
+    struct rand_metadata *metadata = calloc(1, sizeof(struct rand_metadata));
+    rng_seed(&metadata->rng, seed);
+    rand_rp->data = metadata;
 
     return rand_rp;
 }
@@ -136,40 +249,24 @@ struct replacement_policy *rand_replacement_policy_new(uint32_t sets, uint32_t a
 // LRU_PREFER_CLEAN Replacement Policy
 // ============================================================================
 struct lru_prefer_clean_metadata {
-    uint32_t *last_access_times; 
-    uint8_t *is_dirty;           
-    uint32_t access_counter;     
+    struct lru_list recency;
+    uint8_t *is_dirty;
 };
 
 
-void lru_prefer_clean_cache_access(struct replacement_policy *replacement_policy,
-                                   struct cache_system *cache_system, uint32_t set_idx,
-                                   uint32_t tag)
+void lru_prefer_clean_access(struct replacement_policy *replacement_policy,
+                             struct cache_system *cache_system, uint32_t set_idx, uint32_t way,
+                             bool is_hit, char rw)
 {
     struct lru_prefer_clean_metadata *metadata = (struct lru_prefer_clean_metadata *)replacement_policy->data;
-    uint32_t set_base = set_idx * cache_system->associativity;
-    metadata->access_counter++;
-    bool line_modified = false;
-
-    for (uint32_t i = 0; i < cache_system->associativity; ++i) {
-        struct cache_line *line = &cache_system->cache_lines[set_base + i];
-        if (line->tag == tag && line->status != INVALID) {
-            // update the last access time
-            metadata->last_access_times[set_base + i] = metadata->access_counter;
-            line_modified = (line->status == MODIFIED);
-            break;
-        }
-    }
+    uint32_t index = cache_system_line_index(cache_system, set_idx, way);
 
-    // if a line was modified update the is_dirty array
-    if (line_modified) {
-        for (uint32_t i = 0; i < cache_system->associativity; ++i) {
-            struct cache_line *line = &cache_system->cache_lines[set_base + i];
-            if (line->tag == tag && line->status == MODIFIED) {
-                metadata->is_dirty[set_base + i] = 1; // mark the line as dirty
-                break;
-            }
-        }
+    // make the line the most recently used
+    lru_list_touch(&metadata->recency, set_idx, way);
+
+    // if the line was modified update the is_dirty array
+    if (cache_system->statuses[index] == MODIFIED) {
+        metadata->is_dirty[index] = 1; // mark the line as dirty
     }
 }
 
@@ -177,43 +274,44 @@ void lru_prefer_clean_cache_access(struct replacement_policy *replacement_policy
 uint32_t lru_prefer_clean_eviction_index(struct replacement_policy *replacement_policy,
                                          struct cache_system *cache_system, uint32_t set_idx) {
     struct lru_prefer_clean_metadata *metadata = (struct lru_prefer_clean_metadata *)replacement_policy->data;
+    struct lru_list *recency = &metadata->recency;
     uint32_t set_base = set_idx * cache_system->associativity;
 
-    int clean_index = -1; // index of the oldest clean line within the set
-    int dirty_index = -1; // index of the oldest dirty line within the set
-    uint32_t oldest_clean_time = UINT32_MAX; // oldest access time among clean lines
-    uint32_t oldest_dirty_time = UINT32_MAX; // oldest access time among dirty lines
-
-    // iterate over all cache lines within the set to find the eviction candidate
-    for (uint32_t i = 0; i < cache_system->associativity; ++i) {
-        uint32_t index = i; 
-        uint32_t last_access_time = metadata->last_access_times[set_base + index];
-        uint8_t is_dirty = metadata->is_dirty[set_base + index];
-
-        // identify the oldest clean line else if oldest dirty line
-        if (!is_dirty && last_access_time < oldest_clean_time) {
-            oldest_clean_time = last_access_time;
-            clean_index = index;
-        }
-        else if (is_dirty && last_access_time < oldest_dirty_time) {
-            oldest_dirty_time = last_access_time;
-            dirty_index = index;
+    // walk from the least recently used line towards the most recently used
+    // one, and evict the first clean line found
+    uint32_t lru_index = lru_list_least_recent(recency, set_idx);
+    uint32_t index = lru_index;
+    do {
+        if (!metadata->is_dirty[set_base + index]) {
+            return index;
         }
-    }
+        index = recency->prev[set_base + index];
+    } while (index != lru_index);
 
-    // prefer to evict the oldest clean line if it exists if no oldest dirty line
-    if (clean_index != -1) {
-        return clean_index;
-    }
-    else if (dirty_index != -1) {
-        return dirty_index;
-    }
+    // every line is dirty, so evict the least recently used one
+    return lru_index;
+}
 
-    
-    // indicates an error if reaches
-    return UINT32_MAX;
+
+int lru_prefer_clean_save(struct replacement_policy *replacement_policy,
+                          struct cache_system *cache_system, struct checkpoint *checkpoint)
+{
+    struct lru_prefer_clean_metadata *metadata = (struct lru_prefer_clean_metadata *)replacement_policy->data;
+    uint32_t sets = cache_system->num_sets;
+    lru_list_save(&metadata->recency, sets, checkpoint);
+    return checkpoint_write(checkpoint, metadata->is_dirty,
+                            (size_t)sets * cache_system->associativity);
 }
 
+int lru_prefer_clean_load(struct replacement_policy *replacement_policy,
+                          struct cache_system *cache_system, struct checkpoint *checkpoint)
+{
+    struct lru_prefer_clean_metadata *metadata = (struct lru_prefer_clean_metadata *)replacement_policy->data;
+    uint32_t sets = cache_system->num_sets;
+    lru_list_load(&metadata->recency, sets, checkpoint);
+    return checkpoint_read(checkpoint, metadata->is_dirty,
+                           (size_t)sets * cache_system->associativity);
+}
 
 
 void lru_prefer_clean_replacement_policy_cleanup(struct replacement_policy *replacement_policy)
@@ -222,7 +320,7 @@ void lru_prefer_clean_replacement_policy_cleanup(struct replacement_policy *repl
     // lru_prefer_clean_replacement_policy_new function.
     struct lru_prefer_clean_metadata *metadata = (struct lru_prefer_clean_metadata *)replacement_policy->data;
     if (metadata) {
-        free(metadata->last_access_times);
+        lru_list_cleanup(&metadata->recency);
         free(metadata->is_dirty);
         free(metadata);
     }
@@ -231,19 +329,363 @@ void lru_prefer_clean_replacement_policy_cleanup(struct replacement_policy *repl
 struct replacement_policy *lru_prefer_clean_replacement_policy_new(uint32_t sets,
                                                                    uint32_t associativity)
 {
-    struct replacement_policy *lru_prefer_clean_rp = malloc(sizeof(struct replacement_policy));
-    struct lru_prefer_clean_metadata *metadata = malloc(sizeof(struct lru_prefer_clean_metadata));
-
-    metadata->last_access_times = calloc(sets * associativity, sizeof(uint32_t));
+    struct lru_prefer_clean_metadata *metadata = calloc(1, sizeof(struct lru_prefer_clean_metadata));
+    if (!lru_list_init(&metadata->recency, sets, associativity)) {
+        free(metadata);
+        return NULL;
+    }
     metadata->is_dirty = calloc(sets * associativity, sizeof(uint8_t));
-    metadata->access_counter = 0;
 
-    lru_prefer_clean_rp->cache_access = &lru_prefer_clean_cache_access;
+    struct replacement_policy *lru_prefer_clean_rp = calloc(1, sizeof(struct replacement_policy));
+    lru_prefer_clean_rp->access = &lru_prefer_clean_access;
     lru_prefer_clean_rp->eviction_index = &lru_prefer_clean_eviction_index;
+    lru_prefer_clean_rp->save = &lru_prefer_clean_save;
+    lru_prefer_clean_rp->load = &lru_prefer_clean_load;
     lru_prefer_clean_rp->cleanup = &lru_prefer_clean_replacement_policy_cleanup;
     lru_prefer_clean_rp->data = metadata;
-    // allocate any additional memory to store metadata here and assign to
-    // lru_prefer_clean_rp->data.
 
     return lru_prefer_clean_rp;
-}
\ No newline at end of file
+}
+
+// PLRU_TREE and PLRU_BIT Replacement Policies
+// ============================================================================
+// Both pseudo-LRU policies only store a few bits per set, packed into 64-bit
+// words (words_per_set words for each set).
+//
+// PLRU_TREE keeps a binary tree over the ways with one bit per internal node
+// (associativity - 1 bits per set), stored in heap order: node 1 is the root
+// and node n has children 2n and 2n + 1. The leaves are the ways, with way w
+// at node associativity + w. Each bit points towards the half of its subtree
+// that was used less recently (0 for the left child, 1 for the right child).
+//
+// PLRU_BIT keeps one "recently used" bit per way. A way's bit is set when it is
+// accessed, and when every bit in a set would be set, all of the other bits
+// are cleared. The victim is the first way whose bit is clear.
+struct plru_metadata {
+    uint64_t *bits;
+    uint32_t words_per_set;
+};
+
+static inline bool plru_get(uint64_t *set_bits, uint32_t bit)
+{
+    return (set_bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void plru_put(uint64_t *set_bits, uint32_t bit, bool value)
+{
+    uint64_t mask = UINT64_C(1) << (bit % 64);
+    set_bits[bit / 64] = value ? (set_bits[bit / 64] | mask) : (set_bits[bit / 64] & ~mask);
+}
+
+static inline uint64_t *plru_set_bits(struct plru_metadata *metadata, uint32_t set_idx)
+{
+    return &metadata->bits[(uint64_t)set_idx * metadata->words_per_set];
+}
+
+void plru_tree_access(struct replacement_policy *replacement_policy,
+                      struct cache_system *cache_system, uint32_t set_idx, uint32_t way,
+                      bool is_hit, char rw)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    uint64_t *set_bits = plru_set_bits(metadata, set_idx);
+
+    // Walk up from the leaf, pointing every node on the path away from it.
+    for (uint32_t node = cache_system->associativity + way; node > 1; node /= 2) {
+        plru_put(set_bits, node / 2, !(node & 1));
+    }
+}
+
+uint32_t plru_tree_eviction_index(struct replacement_policy *replacement_policy,
+                                  struct cache_system *cache_system, uint32_t set_idx)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    uint64_t *set_bits = plru_set_bits(metadata, set_idx);
+
+    // Follow the bits down from the root.
+    uint32_t node = 1;
+    while (node < cache_system->associativity) {
+        node = 2 * node + plru_get(set_bits, node);
+    }
+    return node - cache_system->associativity;
+}
+
+void plru_bit_access(struct replacement_policy *replacement_policy,
+                     struct cache_system *cache_system, uint32_t set_idx, uint32_t way,
+                     bool is_hit, char rw)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    uint64_t *set_bits = plru_set_bits(metadata, set_idx);
+    plru_put(set_bits, way, true);
+
+    // If every way is now marked, start a new round with only this way marked.
+    uint32_t associativity = cache_system->associativity;
+    for (uint32_t w = 0; w < metadata->words_per_set; w++) {
+        uint32_t ways_in_word = associativity - 64 * w < 64 ? associativity - 64 * w : 64;
+        uint64_t full = ways_in_word == 64 ? UINT64_MAX : (UINT64_C(1) << ways_in_word) - 1;
+        if (set_bits[w] != full) return;
+    }
+    memset(set_bits, 0, metadata->words_per_set * sizeof(uint64_t));
+    plru_put(set_bits, way, true);
+}
+
+uint32_t plru_bit_eviction_index(struct replacement_policy *replacement_policy,
+                                 struct cache_system *cache_system, uint32_t set_idx)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    uint64_t *set_bits = plru_set_bits(metadata, set_idx);
+
+    for (uint32_t w = 0; w < metadata->words_per_set; w++) {
+        if (~set_bits[w] != 0) {
+            uint32_t way = 64 * w + __builtin_ctzll(~set_bits[w]);
+            if (way < cache_system->associativity) return way;
+        }
+    }
+    return 0;
+}
+
+int plru_save(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    return checkpoint_write(checkpoint, metadata->bits,
+                            (size_t)cache_system->num_sets * metadata->words_per_set *
+                                sizeof(uint64_t));
+}
+
+int plru_load(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    return checkpoint_read(checkpoint, metadata->bits,
+                           (size_t)cache_system->num_sets * metadata->words_per_set *
+                               sizeof(uint64_t));
+}
+
+void plru_replacement_policy_cleanup(struct replacement_policy *replacement_policy)
+{
+    struct plru_metadata *metadata = (struct plru_metadata *)replacement_policy->data;
+    if (metadata) {
+        free(metadata->bits);
+        free(metadata);
+    }
+}
+
+static struct replacement_policy *plru_replacement_policy_new(uint32_t sets,
+                                                              uint32_t associativity)
+{
+    struct plru_metadata *metadata = calloc(1, sizeof(struct plru_metadata));
+    metadata->words_per_set = (associativity + 63) / 64;
+    metadata->bits = calloc((uint64_t)sets * metadata->words_per_set, sizeof(uint64_t));
+
+    struct replacement_policy *plru_rp = calloc(1, sizeof(struct replacement_policy));
+    plru_rp->save = &plru_save;
+    plru_rp->load = &plru_load;
+    plru_rp->cleanup = &plru_replacement_policy_cleanup;
+    plru_rp->data = metadata;
+    return plru_rp;
+}
+
+struct replacement_policy *plru_tree_replacement_policy_new(uint32_t sets, uint32_t associativity)
+{
+    if (associativity & (associativity - 1)) {
+        fprintf(stderr, "PLRU_TREE requires a power of two associativity\n");
+        return NULL;
+    }
+
+    struct replacement_policy *plru_tree_rp = plru_replacement_policy_new(sets, associativity);
+    plru_tree_rp->access = &plru_tree_access;
+    plru_tree_rp->eviction_index = &plru_tree_eviction_index;
+    return plru_tree_rp;
+}
+
+struct replacement_policy *plru_bit_replacement_policy_new(uint32_t sets, uint32_t associativity)
+{
+    struct replacement_policy *plru_bit_rp = plru_replacement_policy_new(sets, associativity);
+    plru_bit_rp->access = &plru_bit_access;
+    plru_bit_rp->eviction_index = &plru_bit_eviction_index;
+    return plru_bit_rp;
+}
+
+// SRRIP, BRRIP and DRRIP Replacement Policies
+// ============================================================================
+// Re-reference interval prediction keeps a 2-bit re-reference prediction value
+// (RRPV) per line: 0 means the line is expected to be reused soon and
+// RRIP_MAX_RRPV that it is expected to be reused in the distant future. Hits
+// set the RRPV to 0. The victim is the first way with the maximum RRPV; if no
+// way has it, every RRPV in the set is aged until one does.
+//
+// The policies only differ in the RRPV that new lines get:
+//  * SRRIP inserts at RRIP_MAX_RRPV - 1, so a line has to be reused before it
+//    outlives lines that were.
+//  * BRRIP inserts at RRIP_MAX_RRPV, and only 1 in RRIP_BIMODAL_THROTTLE fills
+//    at RRIP_MAX_RRPV - 1, so scans cannot flush the set.
+//  * DRRIP duels the two: a few leader sets always use SRRIP or BRRIP, and
+//    misses in them move the PSEL counter. The other (follower) sets use
+//    whichever policy is currently missing less. Each policy leads one set in
+//    every RRIP_MIN_LEADER_STRIDE sets, up to RRIP_LEADER_SETS leaders each.
+#define RRIP_MAX_RRPV 3
+#define RRIP_BIMODAL_THROTTLE 32
+#define RRIP_LEADER_SETS 32
+#define RRIP_MIN_LEADER_STRIDE 32
+#define RRIP_PSEL_BITS 10
+#define RRIP_PSEL_MAX ((1 << RRIP_PSEL_BITS) - 1)
+
+enum rrip_mode {
+    RRIP_STATIC,
+    RRIP_BIMODAL,
+    RRIP_DYNAMIC,
+};
+
+struct rrip_metadata {
+    enum rrip_mode mode;
+    uint8_t *rrpv; // Indexed like the cache lines
+    struct rng rng;
+
+    // DRRIP only. Set s is an SRRIP leader if s % leader_stride == 0 and a
+    // BRRIP leader if s % leader_stride == leader_stride - 1. PSEL counts up on
+    // SRRIP leader misses and down on BRRIP leader misses.
+    uint32_t leader_stride;
+    uint32_t psel;
+};
+
+// Which insertion policy the given set uses right now.
+static inline enum rrip_mode rrip_set_mode(struct rrip_metadata *metadata, uint32_t set_idx)
+{
+    if (metadata->mode != RRIP_DYNAMIC) return metadata->mode;
+    if (metadata->leader_stride > 1) {
+        uint32_t offset = set_idx % metadata->leader_stride;
+        if (offset == 0) return RRIP_STATIC;
+        if (offset == metadata->leader_stride - 1) return RRIP_BIMODAL;
+    }
+    return metadata->psel > RRIP_PSEL_MAX / 2 ? RRIP_BIMODAL : RRIP_STATIC;
+}
+
+void rrip_fill(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+               uint32_t set_idx, uint32_t way, char rw)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    enum rrip_mode mode = rrip_set_mode(metadata, set_idx);
+
+    // Every fill is a miss, so this is where the leader sets vote.
+    if (metadata->mode == RRIP_DYNAMIC && metadata->leader_stride > 1) {
+        uint32_t offset = set_idx % metadata->leader_stride;
+        if (offset == 0 && metadata->psel < RRIP_PSEL_MAX) {
+            metadata->psel++;
+        } else if (offset == metadata->leader_stride - 1 && metadata->psel > 0) {
+            metadata->psel--;
+        }
+    }
+
+    uint8_t rrpv = RRIP_MAX_RRPV - 1;
+    if (mode == RRIP_BIMODAL && rng_below(&metadata->rng, RRIP_BIMODAL_THROTTLE) != 0) {
+        rrpv = RRIP_MAX_RRPV;
+    }
+    metadata->rrpv[cache_system_line_index(cache_system, set_idx, way)] = rrpv;
+}
+
+void rrip_access(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                 uint32_t set_idx, uint32_t way, bool is_hit, char rw)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    if (is_hit) metadata->rrpv[cache_system_line_index(cache_system, set_idx, way)] = 0;
+}
+
+uint32_t rrip_eviction_index(struct replacement_policy *replacement_policy,
+                             struct cache_system *cache_system, uint32_t set_idx)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    uint8_t *rrpv = &metadata->rrpv[cache_system_line_index(cache_system, set_idx, 0)];
+
+    // Find the first way with the largest RRPV.
+    uint32_t victim = 0;
+    for (uint32_t i = 1; i < cache_system->associativity && rrpv[victim] < RRIP_MAX_RRPV; i++) {
+        if (rrpv[i] > rrpv[victim]) victim = i;
+    }
+
+    // Age the set so that the victim reaches the maximum RRPV, as if the set
+    // had been searched repeatedly.
+    uint8_t age = RRIP_MAX_RRPV - rrpv[victim];
+    if (age > 0) {
+        for (uint32_t i = 0; i < cache_system->associativity; i++) rrpv[i] += age;
+    }
+    return victim;
+}
+
+int rrip_save(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    checkpoint_write(checkpoint, metadata->rrpv,
+                     (size_t)cache_system->num_sets * cache_system->associativity);
+    checkpoint_write(checkpoint, &metadata->rng, sizeof(metadata->rng));
+    return checkpoint_write(checkpoint, &metadata->psel, sizeof(metadata->psel));
+}
+
+int rrip_load(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+              struct checkpoint *checkpoint)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    checkpoint_read(checkpoint, metadata->rrpv,
+                    (size_t)cache_system->num_sets * cache_system->associativity);
+    checkpoint_read(checkpoint, &metadata->rng, sizeof(metadata->rng));
+    return checkpoint_read(checkpoint, &metadata->psel, sizeof(metadata->psel));
+}
+
+void rrip_replacement_policy_cleanup(struct replacement_policy *replacement_policy)
+{
+    struct rrip_metadata *metadata = (struct rrip_metadata *)replacement_policy->data;
+    if (metadata) {
+        free(metadata->rrpv);
+        free(metadata);
+    }
+}
+
+static struct replacement_policy *rrip_replacement_policy_new(uint32_t sets,
+                                                              uint32_t associativity,
+                                                              enum rrip_mode mode, uint64_t seed)
+{
+    struct rrip_metadata *metadata = calloc(1, sizeof(struct rrip_metadata));
+    metadata->mode = mode;
+    metadata->rrpv = malloc((uint64_t)sets * associativity);
+    memset(metadata->rrpv, RRIP_MAX_RRPV, (uint64_t)sets * associativity);
+    rng_seed(&metadata->rng, seed);
+
+    // Spread the leader sets evenly over the cache, leaving at least
+    // RRIP_MIN_LEADER_STRIDE - 2 followers between leader pairs. Caches with
+    // fewer sets than that get a single pair (the first and the last set).
+    // With fewer than three sets no follower would be left, so there are no
+    // leaders and every set uses SRRIP.
+    uint32_t stride = sets / RRIP_LEADER_SETS;
+    if (stride < RRIP_MIN_LEADER_STRIDE) {
+        stride = sets < RRIP_MIN_LEADER_STRIDE ? sets : RRIP_MIN_LEADER_STRIDE;
+    }
+    metadata->leader_stride = stride >= 3 ? stride : 0;
+    metadata->psel = RRIP_PSEL_MAX / 2;
+
+    struct replacement_policy *rrip_rp = calloc(1, sizeof(struct replacement_policy));
+    rrip_rp->access = &rrip_access;
+    rrip_rp->fill = &rrip_fill;
+    rrip_rp->eviction_index = &rrip_eviction_index;
+    rrip_rp->save = &rrip_save;
+    rrip_rp->load = &rrip_load;
+    rrip_rp->cleanup = &rrip_replacement_policy_cleanup;
+    rrip_rp->data = metadata;
+    return rrip_rp;
+}
+
+struct replacement_policy *srrip_replacement_policy_new(uint32_t sets, uint32_t associativity)
+{
+    return rrip_replacement_policy_new(sets, associativity, RRIP_STATIC, 0);
+}
+
+struct replacement_policy *brrip_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                        uint64_t seed)
+{
+    return rrip_replacement_policy_new(sets, associativity, RRIP_BIMODAL, seed);
+}
+
+struct replacement_policy *drrip_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                        uint64_t seed)
+{
+    return rrip_replacement_policy_new(sets, associativity, RRIP_DYNAMIC, seed);
+}
@@ -1,5 +1,5 @@
 //
-// This file defines the function signatures necessary for creating the three
+// This file defines the function signatures necessary for creating the
 // replacement policies and defines the replacement_policy struct.
 //
 
@@ -11,13 +11,22 @@
 #include <time.h>
 
 struct cache_system;
+struct checkpoint;
 #include "memory_system.h"
 
 // This struct describes the functionality of a replacement policy. The
-// function pointers describe the three functions that every replacement policy
-// must implement. Arbitrary data can be stored in the data pointer and can be
+// function pointers describe the functions that a replacement policy
+// implements. Arbitrary data can be stored in the data pointer and can be
 // used to store the state of the replacement policy between calls to
-// eviction_index and cache_access.
+// eviction_index and the access hooks.
+//
+// There are two versions of the access hooks. Version 1 policies implement
+// cache_access, which only receives the tag of the accessed line, so the
+// policy has to search the set to find the way. Version 2 policies implement
+// access (and optionally fill and evict) instead, which receive the way
+// directly. The cache system only calls the version 2 hooks;
+// cache_system_set_replacement_policy installs an adapter for version 1
+// policies.
 //
 // For those of you who are unfamiliar with function pointers, they take the
 // form:
@@ -48,7 +57,41 @@ struct replacement_policy {
     //  * set_idx: the index of the set that is being accessed.
     //  * tag: the tag within the set that is being accessed.
     void (*cache_access)(struct replacement_policy *replacement_policy,
-                         struct cache_system *cache_system, uint32_t set_idx, uint32_t tag);
+                         struct cache_system *cache_system, uint32_t set_idx, uint64_t tag);
+
+    // Version 2: this function is called after every access, once the
+    // accessed line is in the cache (for misses, after fill).
+    //
+    // Arguments:
+    //  * replacement_policy: the instance of the replacement_policy
+    //  * cache_system: the cache system. This pointer should be treated as
+    //    readonly.
+    //  * set_idx: the index of the set that is being accessed.
+    //  * way: the index within the set of the line that was accessed.
+    //  * is_hit: whether the access was a hit.
+    //  * rw: 'R' for reads and 'W' for writes.
+    void (*access)(struct replacement_policy *replacement_policy,
+                   struct cache_system *cache_system, uint32_t set_idx, uint32_t way, bool is_hit,
+                   char rw);
+
+    // Version 2, optional: called when a new line is stored into a way, before
+    // access is called for it. The arguments are the same as for access.
+    void (*fill)(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                 uint32_t set_idx, uint32_t way, char rw);
+
+    // Version 2, optional: called when the valid line in a way is about to be
+    // evicted (i.e. with the way returned by eviction_index), while the line is
+    // still in the cache.
+    void (*evict)(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                  uint32_t set_idx, uint32_t way);
+
+    // Optional, for policies with state: write the state to a snapshot, or
+    // read it back into a policy created for the same geometry (see
+    // checkpoint.h). Both return non-zero on error.
+    int (*save)(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                struct checkpoint *checkpoint);
+    int (*load)(struct replacement_policy *replacement_policy, struct cache_system *cache_system,
+                struct checkpoint *checkpoint);
 
     // This function is called right before the replacement policy is
     // deallocated. You should perform any necessary cleanup operations here.
@@ -63,10 +106,24 @@ struct replacement_policy {
     void *data;
 };
 
-// Constructors for each of the replacement policies.
+// Fill in the version 2 hooks of a version 1 policy with an adapter that
+// calls cache_access. Does nothing for version 2 policies.
+void replacement_policy_adapt(struct replacement_policy *replacement_policy);
+
+// Constructors for each of the replacement policies. Policies that make random
+// choices take a seed for their own random number generator. PLRU_TREE needs a
+// power of two associativity and returns NULL otherwise.
 struct replacement_policy *lru_replacement_policy_new(uint32_t sets, uint32_t associativity);
-struct replacement_policy *rand_replacement_policy_new(uint32_t sets, uint32_t associativity);
+struct replacement_policy *rand_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                       uint64_t seed);
 struct replacement_policy *lru_prefer_clean_replacement_policy_new(uint32_t sets,
                                                                    uint32_t associativity);
+struct replacement_policy *plru_tree_replacement_policy_new(uint32_t sets, uint32_t associativity);
+struct replacement_policy *plru_bit_replacement_policy_new(uint32_t sets, uint32_t associativity);
+struct replacement_policy *srrip_replacement_policy_new(uint32_t sets, uint32_t associativity);
+struct replacement_policy *brrip_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                        uint64_t seed);
+struct replacement_policy *drrip_replacement_policy_new(uint32_t sets, uint32_t associativity,
+                                                        uint64_t seed);
 
 #endif
@@ -0,0 +1,50 @@
+//
+// This file defines a small, fast pseudo-random number generator. Each user
+// (e.g. a replacement policy instance) owns its own generator, so simulations
+// are reproducible from a seed and independent of each other, even when they
+// run on different threads.
+//
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xorshift64* state. The state must never be zero; rng_seed ensures this.
+struct rng {
+    uint64_t state;
+};
+
+// The splitmix64 finalizer. Useful for turning similar seeds (0, 1, 2, ...)
+// into very different ones.
+static inline uint64_t rng_mix(uint64_t x)
+{
+    x += UINT64_C(0x9e3779b97f4a7c15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+static inline void rng_seed(struct rng *rng, uint64_t seed)
+{
+    rng->state = rng_mix(seed);
+    if (rng->state == 0) rng->state = UINT64_C(0x9e3779b97f4a7c15);
+}
+
+static inline uint64_t rng_next(struct rng *rng)
+{
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * UINT64_C(0x2545f4914f6cdd1d);
+}
+
+// Returns a number in [0, n).
+static inline uint32_t rng_below(struct rng *rng, uint32_t n)
+{
+    return (uint32_t)(((rng_next(rng) >> 32) * n) >> 32);
+}
+
+#endif
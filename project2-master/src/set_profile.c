@@ -0,0 +1,202 @@
+//
+// This file contains the implementations for the functions defined in
+// set_profile.h.
+//
+
+#include "set_profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void set_profile_init(struct set_profile *profile, uint32_t sets)
+{
+    profile->num_sets = sets;
+    profile->sets = calloc(sets, sizeof(struct set_counters));
+    profile->tags = calloc((size_t)sets * SET_PROFILE_TOP_TAGS, sizeof(struct set_profile_tag));
+}
+
+void set_profile_cleanup(struct set_profile *profile)
+{
+    free(profile->sets);
+    free(profile->tags);
+}
+
+void set_profile_reset(struct set_profile *profile)
+{
+    memset(profile->sets, 0, profile->num_sets * sizeof(struct set_counters));
+    memset(profile->tags, 0,
+           (size_t)profile->num_sets * SET_PROFILE_TOP_TAGS * sizeof(struct set_profile_tag));
+}
+
+void set_profile_miss(struct set_profile *profile, uint32_t set_idx, uint64_t tag, bool repeat,
+                      bool conflict)
+{
+    struct set_counters *counters = &profile->sets[set_idx];
+    counters->misses++;
+    if (conflict) counters->conflict_misses++;
+    if (!repeat) return;
+
+    // Count the tag if it is tracked, or else take over the entry with the
+    // lowest count (empty entries have a count of 0).
+    struct set_profile_tag *tags = &profile->tags[(size_t)set_idx * SET_PROFILE_TOP_TAGS];
+    struct set_profile_tag *lowest = &tags[0];
+    for (int i = 0; i < SET_PROFILE_TOP_TAGS; i++) {
+        if (tags[i].count > 0 && tags[i].tag == tag) {
+            tags[i].count++;
+            return;
+        }
+        if (tags[i].count < lowest->count) lowest = &tags[i];
+    }
+    lowest->tag = tag;
+    lowest->error = lowest->count;
+    lowest->count++;
+}
+
+bool set_profile_format_parse(const char *str, enum set_profile_format *out)
+{
+    static const char *names[] = {"csv", "heatmap", "ranked"};
+    for (int i = 0; i < 3; i++) {
+        if (!strcmp(str, names[i])) {
+            *out = (enum set_profile_format)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Exporting
+// ============================================================================
+static int compare_tags(const void *a, const void *b)
+{
+    const struct set_profile_tag *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+// Sort the tracked tags of the set from the most to the least frequent, and
+// return how many there are.
+static int set_profile_sorted_tags(struct set_profile *profile, uint32_t set_idx,
+                                   struct set_profile_tag *out)
+{
+    int count = 0;
+    struct set_profile_tag *tags = &profile->tags[(size_t)set_idx * SET_PROFILE_TOP_TAGS];
+    for (int i = 0; i < SET_PROFILE_TOP_TAGS; i++) {
+        if (tags[i].count > 0) out[count++] = tags[i];
+    }
+    qsort(out, count, sizeof(struct set_profile_tag), compare_tags);
+    return count;
+}
+
+static double miss_ratio(const struct set_counters *counters)
+{
+    return counters->accesses ? (double)counters->misses / counters->accesses : 0.0;
+}
+
+static void set_profile_write_csv(struct set_profile *profile, FILE *file)
+{
+    // The top tags share one column, as TAG:COUNT pairs separated by spaces.
+    fprintf(file, "set,accesses,misses,conflict_misses,evictions,dirty_evictions,miss_ratio,"
+                  "top_tags\n");
+    struct set_profile_tag tags[SET_PROFILE_TOP_TAGS];
+    for (uint32_t set = 0; set < profile->num_sets; set++) {
+        struct set_counters *c = &profile->sets[set];
+        fprintf(file, "%u,%llu,%llu,%llu,%llu,%llu,%.8f,", set, (unsigned long long)c->accesses,
+                (unsigned long long)c->misses, (unsigned long long)c->conflict_misses,
+                (unsigned long long)c->evictions, (unsigned long long)c->dirty_evictions,
+                miss_ratio(c));
+        int count = set_profile_sorted_tags(profile, set, tags);
+        for (int i = 0; i < count; i++) {
+            fprintf(file, "%s0x%llx:%u", i ? " " : "", (unsigned long long)tags[i].tag,
+                    tags[i].count);
+        }
+        fprintf(file, "\n");
+    }
+}
+
+static void set_profile_write_heatmap(struct set_profile *profile, FILE *file)
+{
+    // Each character is one set, shaded by its misses relative to the set with
+    // the most misses.
+    static const char shades[] = " .:-=+*#%@";
+    const int levels = sizeof(shades) - 2;
+    uint64_t max_misses = 0;
+    for (uint32_t set = 0; set < profile->num_sets; set++) {
+        if (profile->sets[set].misses > max_misses) max_misses = profile->sets[set].misses;
+    }
+
+    fprintf(file, "Misses per set (' ' = 0, '@' = %llu), %d sets per line\n",
+            (unsigned long long)max_misses, SET_PROFILE_HEATMAP_WIDTH);
+    for (uint32_t row = 0; row < profile->num_sets; row += SET_PROFILE_HEATMAP_WIDTH) {
+        fprintf(file, "%8u |", row);
+        for (uint32_t set = row; set < row + SET_PROFILE_HEATMAP_WIDTH && set < profile->num_sets;
+             set++) {
+            uint64_t misses = profile->sets[set].misses;
+            uint64_t shade = 0;
+            if (max_misses > 0) shade = (misses * levels + max_misses - 1) / max_misses;
+            fputc(shades[shade], file);
+        }
+        fprintf(file, "|\n");
+    }
+}
+
+struct ranked_set {
+    uint32_t set;
+    const struct set_counters *counters;
+};
+
+// Order sets by conflict misses, then by misses, most first.
+static int compare_sets(const void *a, const void *b)
+{
+    const struct set_counters *x = ((const struct ranked_set *)a)->counters;
+    const struct set_counters *y = ((const struct ranked_set *)b)->counters;
+    if (x->conflict_misses != y->conflict_misses) {
+        return (x->conflict_misses < y->conflict_misses) -
+               (x->conflict_misses > y->conflict_misses);
+    }
+    return (x->misses < y->misses) - (x->misses > y->misses);
+}
+
+static void set_profile_write_ranked(struct set_profile *profile, FILE *file)
+{
+    struct ranked_set *order = malloc(profile->num_sets * sizeof(struct ranked_set));
+    for (uint32_t set = 0; set < profile->num_sets; set++) {
+        order[set] = (struct ranked_set){set, &profile->sets[set]};
+    }
+    qsort(order, profile->num_sets, sizeof(struct ranked_set), compare_sets);
+
+    uint32_t shown = profile->num_sets < SET_PROFILE_RANKED_SETS ? profile->num_sets
+                                                                 : SET_PROFILE_RANKED_SETS;
+    fprintf(file, "Sets with the most conflict misses\n");
+    fprintf(file, "==================================\n");
+    fprintf(file, "%8s %10s %10s %10s %10s %10s %10s  %s\n", "SET", "ACCESSES", "MISSES",
+            "CONFLICT", "EVICTIONS", "DIRTY", "MISS RATIO", "TOP MISSING TAGS (MISSES)");
+    struct set_profile_tag tags[SET_PROFILE_TOP_TAGS];
+    for (uint32_t i = 0; i < shown; i++) {
+        const struct set_counters *c = order[i].counters;
+        fprintf(file, "%8u %10llu %10llu %10llu %10llu %10llu %10.8f ", order[i].set,
+                (unsigned long long)c->accesses, (unsigned long long)c->misses,
+                (unsigned long long)c->conflict_misses, (unsigned long long)c->evictions,
+                (unsigned long long)c->dirty_evictions, miss_ratio(c));
+        int count = set_profile_sorted_tags(profile, order[i].set, tags);
+        for (int j = 0; j < count && j < 4; j++) {
+            fprintf(file, " 0x%llx (%u)", (unsigned long long)tags[j].tag, tags[j].count);
+        }
+        fprintf(file, "\n");
+    }
+    free(order);
+}
+
+int set_profile_write(struct set_profile *profile, FILE *file, enum set_profile_format format)
+{
+    switch (format) {
+    case SET_PROFILE_CSV:
+        set_profile_write_csv(profile, file);
+        break;
+    case SET_PROFILE_HEATMAP:
+        set_profile_write_heatmap(profile, file);
+        break;
+    case SET_PROFILE_RANKED:
+        set_profile_write_ranked(profile, file);
+        break;
+    }
+    return ferror(file) ? 1 : 0;
+}
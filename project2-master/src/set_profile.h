@@ -0,0 +1,75 @@
+//
+// This file defines the set profile, which counts the accesses, misses and
+// evictions of every set separately, to find the sets that cause the
+// conflict misses and the lines that fight over them.
+//
+// The counters of all sets are kept in one flat array. Each set also tracks
+// the tags that miss in it most often (other than on their first access),
+// using the Space-Saving algorithm of Metwally et al. with
+// SET_PROFILE_TOP_TAGS entries: a tag that is not tracked replaces the one
+// with the lowest count and inherits that count, so any tag that misses more
+// than 1 / SET_PROFILE_TOP_TAGS of the time is always among them, and the
+// counts are at most off by the inherited error.
+//
+// The profile can be exported as CSV (one row per set, e.g. for plotting a
+// heatmap), as a text heatmap of the miss counts, or as a table of the sets
+// with the most conflict misses and their most frequently missing tags.
+//
+
+#ifndef SET_PROFILE_H
+#define SET_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SET_PROFILE_TOP_TAGS 8
+#define SET_PROFILE_RANKED_SETS 16
+#define SET_PROFILE_HEATMAP_WIDTH 64 // Sets per line of the text heatmap
+
+struct set_counters {
+    uint64_t accesses;        // Demand accesses
+    uint64_t misses;          // Demand misses
+    uint64_t conflict_misses; // Demand misses counted as conflict misses
+    uint64_t evictions;       // Valid lines evicted, including by prefetches
+    uint64_t dirty_evictions;
+};
+
+// A tracked tag and its approximate number of misses. The true count is
+// between count - error and count.
+struct set_profile_tag {
+    uint64_t tag;
+    uint32_t count, error;
+};
+
+struct set_profile {
+    uint32_t num_sets;
+    struct set_counters *sets;
+    struct set_profile_tag *tags; // SET_PROFILE_TOP_TAGS per set; count 0 marks an empty entry
+};
+
+enum set_profile_format {
+    SET_PROFILE_CSV,
+    SET_PROFILE_HEATMAP,
+    SET_PROFILE_RANKED,
+};
+
+void set_profile_init(struct set_profile *profile, uint32_t sets);
+void set_profile_cleanup(struct set_profile *profile);
+
+// Zero every counter and forget the tracked tags.
+void set_profile_reset(struct set_profile *profile);
+
+// Record a demand miss in the set. repeat is false for compulsory misses,
+// whose tags are not tracked.
+void set_profile_miss(struct set_profile *profile, uint32_t set_idx, uint64_t tag, bool repeat,
+                      bool conflict);
+
+// Parse a format name ("csv", "heatmap" or "ranked"). Returns false if the
+// name is unknown.
+bool set_profile_format_parse(const char *str, enum set_profile_format *out);
+
+// Write the profile to the file in the given format. Returns 0 on success.
+int set_profile_write(struct set_profile *profile, FILE *file, enum set_profile_format format);
+
+#endif
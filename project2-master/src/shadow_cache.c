@@ -0,0 +1,150 @@
+//
+// This file contains the implementations for the functions defined in
+// shadow_cache.h.
+//
+
+#include "shadow_cache.h"
+
+#include <stdlib.h>
+
+#include "checkpoint.h"
+
+#define SHADOW_CACHE_NONE UINT32_MAX
+
+// Fibonacci hashing, as in line_set.c.
+static inline uint32_t shadow_cache_slot(const struct shadow_cache *shadow, uint64_t line_id)
+{
+    return ((line_id + 1) * UINT64_C(0x9e3779b97f4a7c15) >> 20) & shadow->slot_mask;
+}
+
+// Returns the slot that holds the line's entry, or the empty slot where it
+// would go.
+static uint32_t shadow_cache_find_slot(const struct shadow_cache *shadow, uint64_t line_id)
+{
+    uint32_t slot = shadow_cache_slot(shadow, line_id);
+    while (shadow->slots[slot] != 0 && shadow->line_ids[shadow->slots[slot] - 1] != line_id) {
+        slot = (slot + 1) & shadow->slot_mask;
+    }
+    return slot;
+}
+
+// Remove the slot from the index, shifting later entries of the probe run back
+// into the hole (see line_set_remove).
+static void shadow_cache_remove_slot(struct shadow_cache *shadow, uint32_t slot)
+{
+    uint32_t mask = shadow->slot_mask;
+    uint32_t hole = slot;
+    for (uint32_t next = (hole + 1) & mask; shadow->slots[next] != 0; next = (next + 1) & mask) {
+        uint32_t home = shadow_cache_slot(shadow, shadow->line_ids[shadow->slots[next] - 1]);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            shadow->slots[hole] = shadow->slots[next];
+            hole = next;
+        }
+    }
+    shadow->slots[hole] = 0;
+}
+
+static void shadow_cache_unlink(struct shadow_cache *shadow, uint32_t entry)
+{
+    uint32_t prev = shadow->prev[entry], next = shadow->next[entry];
+    if (prev != SHADOW_CACHE_NONE) {
+        shadow->next[prev] = next;
+    } else {
+        shadow->head = next;
+    }
+    if (next != SHADOW_CACHE_NONE) {
+        shadow->prev[next] = prev;
+    } else {
+        shadow->tail = prev;
+    }
+}
+
+static void shadow_cache_push_front(struct shadow_cache *shadow, uint32_t entry)
+{
+    shadow->prev[entry] = SHADOW_CACHE_NONE;
+    shadow->next[entry] = shadow->head;
+    if (shadow->head != SHADOW_CACHE_NONE) {
+        shadow->prev[shadow->head] = entry;
+    } else {
+        shadow->tail = entry;
+    }
+    shadow->head = entry;
+}
+
+void shadow_cache_init(struct shadow_cache *shadow, uint32_t capacity)
+{
+    shadow->capacity = capacity;
+    shadow->size = 0;
+    shadow->line_ids = calloc(capacity, sizeof(uint64_t));
+    shadow->prev = calloc(capacity, sizeof(uint32_t));
+    shadow->next = calloc(capacity, sizeof(uint32_t));
+    shadow->head = shadow->tail = SHADOW_CACHE_NONE;
+
+    uint32_t num_slots = 16;
+    while (num_slots < 2 * capacity) num_slots *= 2;
+    shadow->slots = calloc(num_slots, sizeof(uint32_t));
+    shadow->slot_mask = num_slots - 1;
+}
+
+void shadow_cache_cleanup(struct shadow_cache *shadow)
+{
+    free(shadow->line_ids);
+    free(shadow->prev);
+    free(shadow->next);
+    free(shadow->slots);
+}
+
+bool shadow_cache_access(struct shadow_cache *shadow, uint64_t line_id)
+{
+    uint32_t slot = shadow_cache_find_slot(shadow, line_id);
+    if (shadow->slots[slot] != 0) {
+        uint32_t entry = shadow->slots[slot] - 1;
+        if (shadow->head != entry) {
+            shadow_cache_unlink(shadow, entry);
+            shadow_cache_push_front(shadow, entry);
+        }
+        return true;
+    }
+
+    // Reuse the least recently used entry if the cache is full.
+    uint32_t entry;
+    if (shadow->size < shadow->capacity) {
+        entry = shadow->size++;
+    } else {
+        entry = shadow->tail;
+        shadow_cache_remove_slot(shadow, shadow_cache_find_slot(shadow, shadow->line_ids[entry]));
+        shadow_cache_unlink(shadow, entry);
+
+        // Removing the old line may have moved the slot for the new one.
+        slot = shadow_cache_find_slot(shadow, line_id);
+    }
+
+    shadow->line_ids[entry] = line_id;
+    shadow->slots[slot] = entry + 1;
+    shadow_cache_push_front(shadow, entry);
+    return false;
+}
+
+int shadow_cache_save(const struct shadow_cache *shadow, struct checkpoint *checkpoint)
+{
+    // The lines are saved from the least to the most recently used, so that
+    // accessing them in that order restores the recency list.
+    checkpoint_write(checkpoint, &shadow->size, sizeof(shadow->size));
+    for (uint32_t entry = shadow->tail; entry != SHADOW_CACHE_NONE; entry = shadow->prev[entry]) {
+        checkpoint_write(checkpoint, &shadow->line_ids[entry], sizeof(uint64_t));
+    }
+    return checkpoint_status(checkpoint);
+}
+
+int shadow_cache_load(struct shadow_cache *shadow, struct checkpoint *checkpoint)
+{
+    uint32_t size = 0;
+    uint64_t line_id;
+    checkpoint_read(checkpoint, &size, sizeof(size));
+    if (size > shadow->capacity) return 1;
+    for (uint32_t i = 0; i < size; i++) {
+        if (checkpoint_read(checkpoint, &line_id, sizeof(line_id)) != 0) return 1;
+        shadow_cache_access(shadow, line_id);
+    }
+    return checkpoint_status(checkpoint);
+}
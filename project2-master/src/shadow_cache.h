@@ -0,0 +1,53 @@
+//
+// This file defines the shadow cache, a fully-associative LRU cache of line
+// IDs that the cache system runs alongside the real cache to split its misses
+// into the three Cs.
+//
+// A demand miss is compulsory if the line was never accessed before. Of the
+// others, a miss that the shadow cache (with the same number of lines, but no
+// sets) also misses on is a capacity miss: no placement could have kept the
+// line. The rest are conflict misses, caused by the set mapping.
+//
+// Only the demand accesses go to the shadow cache, so prefetches do not change
+// the classification. Every access is O(1): the lines are kept in a recency
+// list, and an open-addressing index maps line IDs to list entries.
+//
+
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct checkpoint;
+
+struct shadow_cache {
+    uint32_t capacity, size; // In lines
+
+    // The entries, linked into a list from the most recently used (head) to
+    // the least recently used (tail).
+    uint64_t *line_ids;
+    uint32_t *prev, *next;
+    uint32_t head, tail;
+
+    // Maps line IDs to entries: entry + 1 for each occupied slot, 0 for empty
+    // slots. There are at least twice as many slots as entries.
+    uint32_t *slots;
+    uint32_t slot_mask;
+};
+
+// Initialize an empty shadow cache that holds the given number of lines.
+void shadow_cache_init(struct shadow_cache *shadow, uint32_t capacity);
+void shadow_cache_cleanup(struct shadow_cache *shadow);
+
+// Access the line, making it the most recently used and evicting the least
+// recently used line if the cache is full. Returns true on a hit.
+bool shadow_cache_access(struct shadow_cache *shadow, uint64_t line_id);
+
+// Write the lines of the shadow cache to a snapshot, or restore them into an
+// empty shadow cache of the same capacity (see checkpoint.h). Return 0 on
+// success.
+int shadow_cache_save(const struct shadow_cache *shadow, struct checkpoint *checkpoint);
+int shadow_cache_load(struct shadow_cache *shadow, struct checkpoint *checkpoint);
+
+#endif
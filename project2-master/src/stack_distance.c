@@ -0,0 +1,325 @@
+//
+// This file contains the implementation of the stack distance engine defined
+// in stack_distance.h.
+//
+
+#include "stack_distance.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define STACK_DISTANCE_INITIAL_CAPACITY 16
+#define STACK_DISTANCE_MAP_INITIAL_CAPACITY 1024
+#define STACK_DISTANCE_NO_OWNER UINT64_MAX
+#define MRC_DEFAULT_MAX_SETS 65536
+#define MRC_MAX_SET_COUNTS 64
+
+// The per-set state. Times are set-local: the n-th access to the set happens
+// at time n. A time is "live" if it is the most recent access of some line.
+struct stack_distance_set {
+    uint32_t *tree;  // Fenwick tree (1-based) counting the live times
+    uint64_t *owner; // The line ID whose most recent access is at each time
+    uint32_t capacity, next_time, live;
+};
+
+static const struct option mrc_long_options[] = {
+    {"trace", required_argument, NULL, 't'},
+    {"max-assoc", required_argument, NULL, 'a'},
+    {"all", no_argument, NULL, 'A'},
+    {"csv", no_argument, NULL, 'C'},
+    {NULL, 0, NULL, 0},
+};
+
+// Fenwick tree helpers
+// ============================================================================
+static inline void fenwick_add(uint32_t *tree, uint32_t capacity, uint32_t time, int32_t delta)
+{
+    for (uint32_t i = time + 1; i <= capacity; i += i & -i) tree[i] += delta;
+}
+
+// Sum of the counts at times [0, time].
+static inline uint32_t fenwick_prefix(uint32_t *tree, uint32_t time)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = time + 1; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+// Line map
+// ============================================================================
+static inline uint64_t line_hash(uint64_t line_id)
+{
+    return (line_id * UINT64_C(0x9e3779b97f4a7c15)) >> 17;
+}
+
+static uint64_t map_find_slot(struct stack_distance *sd, uint64_t line_id)
+{
+    uint64_t mask = sd->map_capacity - 1;
+    uint64_t slot = line_hash(line_id) & mask;
+    while (sd->map_keys[slot] != 0 && sd->map_keys[slot] != line_id + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void map_grow(struct stack_distance *sd)
+{
+    uint64_t *old_keys = sd->map_keys;
+    uint32_t *old_values = sd->map_values;
+    uint64_t old_capacity = sd->map_capacity;
+
+    sd->map_capacity *= 2;
+    sd->map_keys = calloc(sd->map_capacity, sizeof(uint64_t));
+    sd->map_values = malloc(sd->map_capacity * sizeof(uint32_t));
+    for (uint64_t i = 0; i < old_capacity; i++) {
+        if (old_keys[i] == 0) continue;
+        uint64_t slot = map_find_slot(sd, old_keys[i] - 1);
+        sd->map_keys[slot] = old_keys[i];
+        sd->map_values[slot] = old_values[i];
+    }
+    free(old_keys);
+    free(old_values);
+}
+
+// Sets
+// ============================================================================
+static void set_init(struct stack_distance_set *set, uint32_t capacity)
+{
+    set->capacity = capacity;
+    set->tree = calloc(capacity + 1, sizeof(uint32_t));
+    set->owner = malloc(capacity * sizeof(uint64_t));
+    for (uint32_t i = 0; i < capacity; i++) set->owner[i] = STACK_DISTANCE_NO_OWNER;
+}
+
+// Renumber the live times of a set to 0, 1, 2, ... (keeping their order) so
+// that there is room for new accesses. The set grows if it is over half full.
+static void set_compact(struct stack_distance *sd, struct stack_distance_set *set)
+{
+    uint32_t old_capacity = set->capacity;
+    uint64_t *old_owner = set->owner;
+    free(set->tree);
+
+    uint32_t capacity = old_capacity;
+    if (set->live * 2 > capacity) capacity *= 2;
+    set_init(set, capacity);
+
+    uint32_t time = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_owner[i] == STACK_DISTANCE_NO_OWNER) continue;
+        set->owner[time] = old_owner[i];
+        sd->map_values[map_find_slot(sd, old_owner[i])] = time;
+        set->tree[time + 1] = 1;
+        time++;
+    }
+    set->next_time = time;
+    free(old_owner);
+
+    // Build the Fenwick tree in place in O(capacity).
+    for (uint32_t i = 1; i <= capacity; i++) {
+        uint32_t parent = i + (i & -i);
+        if (parent <= capacity) set->tree[parent] += set->tree[i];
+    }
+}
+
+// Stack distance engine
+// ============================================================================
+struct stack_distance *stack_distance_new(uint32_t line_size, uint32_t sets,
+                                          uint32_t max_associativity)
+{
+    struct stack_distance *sd = calloc(1, sizeof(struct stack_distance));
+    sd->line_size = line_size;
+    sd->num_sets = sets;
+    sd->max_associativity = max_associativity;
+    sd->offset_bits = log2(line_size);
+    sd->set_index_mask = sets - 1;
+
+    sd->histogram = calloc(max_associativity + 1, sizeof(uint64_t));
+
+    sd->sets = calloc(sets, sizeof(struct stack_distance_set));
+    for (uint32_t i = 0; i < sets; i++) set_init(&sd->sets[i], STACK_DISTANCE_INITIAL_CAPACITY);
+
+    sd->map_capacity = STACK_DISTANCE_MAP_INITIAL_CAPACITY;
+    sd->map_keys = calloc(sd->map_capacity, sizeof(uint64_t));
+    sd->map_values = malloc(sd->map_capacity * sizeof(uint32_t));
+    return sd;
+}
+
+void stack_distance_cleanup(struct stack_distance *sd)
+{
+    for (uint32_t i = 0; i < sd->num_sets; i++) {
+        free(sd->sets[i].tree);
+        free(sd->sets[i].owner);
+    }
+    free(sd->sets);
+    free(sd->histogram);
+    free(sd->map_keys);
+    free(sd->map_values);
+}
+
+void stack_distance_access(struct stack_distance *sd, uint64_t address)
+{
+    uint64_t line_id = address >> sd->offset_bits;
+    struct stack_distance_set *set = &sd->sets[line_id & sd->set_index_mask];
+    sd->accesses++;
+
+    if (set->next_time == set->capacity) set_compact(sd, set);
+    uint32_t now = set->next_time++;
+
+    uint64_t slot = map_find_slot(sd, line_id);
+    if (sd->map_keys[slot] == 0) {
+        // First access to the line: infinite stack distance.
+        sd->cold_misses++;
+        set->live++;
+        if ((sd->map_size + 1) * 2 > sd->map_capacity) {
+            map_grow(sd);
+            slot = map_find_slot(sd, line_id);
+        }
+        sd->map_keys[slot] = line_id + 1;
+        sd->map_size++;
+    } else {
+        // The distance is the number of live times since the previous access.
+        uint32_t previous = sd->map_values[slot];
+        uint32_t distance =
+            fenwick_prefix(set->tree, now - 1) - fenwick_prefix(set->tree, previous);
+        sd->histogram[distance < sd->max_associativity ? distance : sd->max_associativity]++;
+
+        fenwick_add(set->tree, set->capacity, previous, -1);
+        set->owner[previous] = STACK_DISTANCE_NO_OWNER;
+    }
+
+    fenwick_add(set->tree, set->capacity, now, 1);
+    set->owner[now] = line_id;
+    sd->map_values[slot] = now;
+}
+
+uint64_t stack_distance_hits(struct stack_distance *sd, uint32_t associativity)
+{
+    if (associativity > sd->max_associativity) associativity = sd->max_associativity;
+
+    uint64_t hits = 0;
+    for (uint32_t d = 0; d < associativity; d++) hits += sd->histogram[d];
+    return hits;
+}
+
+// mrc subcommand
+// ============================================================================
+static bool is_power_of_two(uint32_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static void mrc_print(struct stack_distance *sd, uint32_t associativity, bool csv)
+{
+    uint32_t lines = sd->num_sets * associativity;
+    uint64_t hits = stack_distance_hits(sd, associativity);
+    uint64_t misses = sd->accesses - hits;
+    double hit_ratio = (double)hits / sd->accesses;
+
+    if (csv) {
+        printf("%llu,%u,%u,%u,%u,%llu,%llu,%llu,%llu,%.8f\n",
+               (unsigned long long)lines * sd->line_size, lines, associativity, sd->num_sets,
+               sd->line_size, (unsigned long long)sd->accesses, (unsigned long long)hits,
+               (unsigned long long)misses, (unsigned long long)sd->cold_misses, hit_ratio);
+    } else {
+        printf("%12llu %10u %6u %8u %6u %12llu %12llu %12llu %12llu %10.8f\n",
+               (unsigned long long)lines * sd->line_size, lines, associativity, sd->num_sets,
+               sd->line_size, (unsigned long long)sd->accesses, (unsigned long long)hits,
+               (unsigned long long)misses, (unsigned long long)sd->cold_misses, hit_ratio);
+    }
+}
+
+int stack_distance_main(int argc, char **argv)
+{
+    char *trace_path = NULL;
+    uint32_t max_associativity = 64;
+    bool all = false, csv = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:a:", mrc_long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'a':
+            max_associativity = strtoul(optarg, NULL, 10);
+            if (max_associativity == 0) {
+                fprintf(stderr, "Invalid maximum associativity %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'A':
+            all = true;
+            break;
+        case 'C':
+            csv = true;
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    if (optind >= argc || argc - optind - 1 > MRC_MAX_SET_COUNTS) {
+        fprintf(stderr, "Usage: cachesim mrc [options] LINE_SIZE [SETS...]\n");
+        return 1;
+    }
+    uint32_t line_size = strtoul(argv[optind], NULL, 10);
+    if (!is_power_of_two(line_size)) {
+        fprintf(stderr, "The line size must be a power of two\n");
+        return 1;
+    }
+
+    // Create one analysis per set count.
+    struct stack_distance *analyses[MRC_MAX_SET_COUNTS];
+    int num_analyses = 0;
+    if (optind + 1 == argc) {
+        for (uint32_t sets = 1; sets <= MRC_DEFAULT_MAX_SETS; sets *= 2) {
+            analyses[num_analyses++] = stack_distance_new(line_size, sets, max_associativity);
+        }
+    }
+    for (int i = optind + 1; i < argc; i++) {
+        uint32_t sets = strtoul(argv[i], NULL, 10);
+        if (!is_power_of_two(sets)) {
+            fprintf(stderr, "The number of sets must be a power of two\n");
+            return 1;
+        }
+        analyses[num_analyses++] = stack_distance_new(line_size, sets, max_associativity);
+    }
+
+    struct trace_reader *trace = trace_reader_open(trace_path);
+    if (trace == NULL) return 1;
+
+    const struct trace_record *records;
+    size_t count;
+    while ((count = trace_reader_next(trace, &records)) > 0) {
+        for (int j = 0; j < num_analyses; j++) {
+            for (size_t i = 0; i < count; i++) {
+                stack_distance_access(analyses[j], trace_record_address(records[i]));
+            }
+        }
+    }
+    if (trace_reader_close(trace) != 0) return 1;
+
+    if (csv) {
+        printf("cache_size,cache_lines,associativity,sets,line_size,accesses,hits,misses,"
+               "compulsory_misses,hit_ratio\n");
+    } else {
+        printf("LRU Miss Ratio Curve\n");
+        printf("====================\n");
+        printf("%12s %10s %6s %8s %6s %12s %12s %12s %12s %10s\n", "SIZE", "LINES", "ASSOC",
+               "SETS", "LINE", "ACCESSES", "HITS", "MISSES", "COMPULSORY", "HIT_RATIO");
+    }
+
+    for (int j = 0; j < num_analyses; j++) {
+        for (uint32_t a = 1; a <= max_associativity; a++) {
+            if (all || is_power_of_two(a) || a == max_associativity) mrc_print(analyses[j], a, csv);
+        }
+        stack_distance_cleanup(analyses[j]);
+        free(analyses[j]);
+    }
+    return 0;
+}
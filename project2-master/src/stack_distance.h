@@ -0,0 +1,71 @@
+//
+// This file defines the stack distance (Mattson) analysis engine, which
+// computes the LRU hit counts of every associativity for a fixed line size and
+// number of sets in a single pass over a trace.
+//
+// For each access, the engine finds the number of distinct lines in the same
+// set that were accessed since the previous access to the same line (the
+// line's stack distance). An LRU cache with A ways hits exactly on the
+// accesses with a stack distance below A, so one histogram of stack distances
+// gives the whole miss ratio curve. Each set keeps a Fenwick tree over the
+// set-local access times, marking the times that are the most recent access
+// of some line, so each access costs O(log M) where M is the number of
+// distinct lines in the set.
+//
+// The `cachesim mrc` subcommand prints the curve:
+//
+//      cachesim mrc [options] LINE_SIZE [SETS...]
+//
+// With no SETS, every power of two from 1 to 65536 sets is analysed.
+//
+// Options:
+//      -t, --trace FILE      read the trace from FILE instead of stdin
+//      -a, --max-assoc N     the largest associativity to report (default 64)
+//      --all                 report every associativity up to the maximum,
+//                            not just the powers of two
+//      --csv                 print the results as CSV instead of a table
+//
+
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct stack_distance_set;
+
+struct stack_distance {
+    uint32_t line_size, num_sets, max_associativity;
+    uint32_t offset_bits, set_index_mask;
+
+    // histogram[d] is the number of accesses with stack distance d, for
+    // d < max_associativity. histogram[max_associativity] counts every
+    // access with a larger distance, and cold_misses every first access.
+    uint64_t *histogram;
+    uint64_t accesses, cold_misses;
+
+    struct stack_distance_set *sets;
+
+    // Map from line ID to the set-local time of its most recent access.
+    uint64_t *map_keys; // line ID + 1, or 0 for an empty slot
+    uint32_t *map_values;
+    uint64_t map_capacity, map_size;
+};
+
+// Create a new analysis for the given geometry. Distances of max_associativity
+// or more are all counted as misses.
+struct stack_distance *stack_distance_new(uint32_t line_size, uint32_t sets,
+                                          uint32_t max_associativity);
+void stack_distance_cleanup(struct stack_distance *stack_distance);
+
+// Record an access to the given address.
+void stack_distance_access(struct stack_distance *stack_distance, uint64_t address);
+
+// The number of hits that an LRU cache with this line size, number of sets
+// and the given associativity would have had on the accesses so far.
+uint64_t stack_distance_hits(struct stack_distance *stack_distance, uint32_t associativity);
+
+// The entrypoint for `cachesim mrc`. argv[0] is "mrc".
+int stack_distance_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,403 @@
+//
+// This file contains the implementation of the sweep mode defined in
+// sweep.h.
+//
+
+#include "sweep.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#define SPEC_FIELDS 6
+#define SPEC_LINE_SIZE 1024
+
+struct sweep {
+    struct sweep_instance *instances;
+    size_t num_instances, capacity;
+
+    // State shared by the worker pool. Thread 0 (the main thread) reads each
+    // batch from the trace, then every thread simulates its own instances
+    // over it. The barrier separates the two phases. Workers wait on
+    // start_lock until the main thread knows how many of them started.
+    struct trace_reader *trace;
+    size_t num_threads;
+    pthread_mutex_t start_lock;
+    pthread_barrier_t barrier;
+    const struct trace_record *records;
+    size_t count;
+};
+
+struct sweep_worker {
+    struct sweep *sweep;
+    size_t thread_idx;
+};
+
+static const struct option sweep_long_options[] = {
+    {"trace", required_argument, NULL, 't'},
+    {"config", required_argument, NULL, 'c'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"seed", required_argument, NULL, 's'},
+    {"prefetch-distance", required_argument, NULL, 'd'},
+    {"prefetch-filter", no_argument, NULL, 'f'},
+    {"csv", no_argument, NULL, 'C'},
+    {NULL, 0, NULL, 0},
+};
+
+// Parsing configurations
+// ============================================================================
+static bool parse_uint32(const char *str, uint32_t *out)
+{
+    char *endptr;
+    unsigned long value = strtoul(str, &endptr, 10);
+    if (*str == '\0' || *endptr != '\0' || value > UINT32_MAX) return false;
+    *out = value;
+    return true;
+}
+
+static void sweep_add(struct sweep *sweep, const struct cache_config *config)
+{
+    if (sweep->num_instances == sweep->capacity) {
+        sweep->capacity = sweep->capacity ? 2 * sweep->capacity : 16;
+        sweep->instances = realloc(sweep->instances, sweep->capacity * sizeof(struct sweep_instance));
+    }
+    struct sweep_instance *instance = &sweep->instances[sweep->num_instances++];
+    instance->config = *config;
+    instance->cache_system = NULL;
+    instance->status = 0;
+}
+
+// Add every combination of the comma-separated values in the given fields.
+// Fields are consumed left to right, so the last field varies fastest.
+static bool sweep_add_product(struct sweep *sweep, char **fields, int field,
+                              struct cache_config *config)
+{
+    if (field == SPEC_FIELDS) {
+        if (cache_config_validate(config)) {
+            sweep_add(sweep, config);
+        } else {
+            fprintf(stderr, "Skipping %s:%u:%u:%u:%s:%u\n", config->replacement_policy,
+                    config->cache_size, config->cache_lines, config->associativity,
+                    config->prefetcher, config->prefetch_amount);
+        }
+        return true;
+    }
+
+    char values[SPEC_LINE_SIZE];
+    snprintf(values, sizeof(values), "%s", fields[field]);
+
+    char *saveptr;
+    for (char *value = strtok_r(values, ",", &saveptr); value != NULL;
+         value = strtok_r(NULL, ",", &saveptr)) {
+        bool ok = true;
+        switch (field) {
+        case 0:
+            snprintf(config->replacement_policy, CONFIG_NAME_SIZE, "%s", value);
+            break;
+        case 1:
+            ok = parse_uint32(value, &config->cache_size);
+            break;
+        case 2:
+            ok = parse_uint32(value, &config->cache_lines);
+            break;
+        case 3:
+            ok = parse_uint32(value, &config->associativity);
+            break;
+        case 4:
+            snprintf(config->prefetcher, CONFIG_NAME_SIZE, "%s", value);
+            break;
+        case 5:
+            ok = parse_uint32(value, &config->prefetch_amount);
+            break;
+        }
+        if (!ok) {
+            fprintf(stderr, "Invalid number %s\n", value);
+            return false;
+        }
+        if (!sweep_add_product(sweep, fields, field + 1, config)) return false;
+    }
+    return true;
+}
+
+// Parse a spec, with fields separated by any of the given separators.
+static bool sweep_add_spec(struct sweep *sweep, const char *spec, const char *separators)
+{
+    char buffer[SPEC_LINE_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+
+    char *fields[SPEC_FIELDS];
+    int num_fields = 0;
+    char *saveptr;
+    for (char *field = strtok_r(buffer, separators, &saveptr); field != NULL;
+         field = strtok_r(NULL, separators, &saveptr)) {
+        if (num_fields == SPEC_FIELDS) {
+            num_fields++;
+            break;
+        }
+        fields[num_fields++] = field;
+    }
+    if (num_fields != SPEC_FIELDS) {
+        fprintf(stderr, "Invalid sweep spec %s (expected %d fields)\n", spec, SPEC_FIELDS);
+        return false;
+    }
+
+    struct cache_config config;
+    memset(&config, 0, sizeof(config));
+    return sweep_add_product(sweep, fields, 0, &config);
+}
+
+static bool sweep_add_config_file(struct sweep *sweep, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open sweep config %s\n", path);
+        return false;
+    }
+
+    char line[SPEC_LINE_SIZE];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        // Ignore comments and blank lines.
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        ok = sweep_add_spec(sweep, line, ": \t\r\n");
+    }
+    fclose(file);
+    return ok;
+}
+
+// Running the sweep
+// ============================================================================
+void sweep_run_batch(struct sweep_instance *instances, size_t num_instances, size_t first,
+                     size_t stride, const struct trace_record *records, size_t count)
+{
+    for (size_t j = first; j < num_instances; j += stride) {
+        struct sweep_instance *instance = &instances[j];
+        if (instance->status != 0) continue;
+
+        struct cache_system *cache_system = instance->cache_system;
+        for (size_t i = 0; i < count; i++) {
+            if (cache_system_mem_access(cache_system, trace_record_address(records[i]),
+                                        trace_record_rw(records[i]), false) != 0) {
+                instance->status = 1;
+                break;
+            }
+        }
+    }
+}
+
+// The body of every thread in the worker pool. Worker i owns the instances
+// i, i + num_threads, i + 2 * num_threads, etc.
+static void *sweep_worker_run(void *arg)
+{
+    struct sweep_worker *worker = arg;
+    struct sweep *sweep = worker->sweep;
+
+    pthread_mutex_lock(&sweep->start_lock);
+    pthread_mutex_unlock(&sweep->start_lock);
+    while (true) {
+        if (worker->thread_idx == 0) {
+            sweep->count = trace_reader_next(sweep->trace, &sweep->records);
+        }
+        pthread_barrier_wait(&sweep->barrier);
+        if (sweep->count == 0) break;
+
+        sweep_run_batch(sweep->instances, sweep->num_instances, worker->thread_idx,
+                        sweep->num_threads, sweep->records, sweep->count);
+
+        // Don't let thread 0 replace the batch until everyone is done with it.
+        pthread_barrier_wait(&sweep->barrier);
+    }
+    return NULL;
+}
+
+static void sweep_run(struct sweep *sweep)
+{
+    if (sweep->num_threads == 1) {
+        while ((sweep->count = trace_reader_next(sweep->trace, &sweep->records)) > 0) {
+            sweep_run_batch(sweep->instances, sweep->num_instances, 0, 1, sweep->records,
+                            sweep->count);
+        }
+        return;
+    }
+
+    // If a thread cannot be created, carry on with the ones that were. The
+    // workers only read num_threads and use the barrier once start_lock is
+    // released, so both can still be set for the actual number of threads.
+    pthread_mutex_init(&sweep->start_lock, NULL);
+    pthread_mutex_lock(&sweep->start_lock);
+    pthread_t *threads = calloc(sweep->num_threads, sizeof(pthread_t));
+    struct sweep_worker *workers = calloc(sweep->num_threads, sizeof(struct sweep_worker));
+    size_t started = 1;
+    for (size_t i = 0; i < sweep->num_threads; i++) {
+        workers[i].sweep = sweep;
+        workers[i].thread_idx = i;
+        if (i == 0) continue;
+        int error = pthread_create(&threads[i], NULL, &sweep_worker_run, &workers[i]);
+        if (error != 0) {
+            fprintf(stderr, "Could not start sweep thread %zu (%s), using %zu threads\n", i + 1,
+                    strerror(error), started);
+            break;
+        }
+        started++;
+    }
+    sweep->num_threads = started;
+    pthread_barrier_init(&sweep->barrier, NULL, sweep->num_threads);
+    pthread_mutex_unlock(&sweep->start_lock);
+
+    // The main thread is worker 0.
+    sweep_worker_run(&workers[0]);
+
+    for (size_t i = 1; i < sweep->num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&sweep->barrier);
+    pthread_mutex_destroy(&sweep->start_lock);
+    free(workers);
+    free(threads);
+}
+
+static void sweep_print_results(struct sweep *sweep, bool csv)
+{
+    if (csv) {
+        printf("policy,cache_size,cache_lines,associativity,prefetcher,prefetch_amount,accesses,"
+               "hits,misses,prefetches,compulsory_misses,conflict_misses,dirty_evictions,"
+               "hit_ratio\n");
+    } else {
+        printf("Sweep Results\n");
+        printf("=============\n");
+        printf("%-18s %10s %8s %6s %-10s %6s %10s %10s %10s %10s %10s %10s %10s %10s\n", "POLICY",
+               "SIZE", "LINES", "ASSOC", "PREFETCHER", "AMOUNT", "ACCESSES", "HITS", "MISSES",
+               "PREFETCHES", "COMPULSORY", "CONFLICT", "DIRTY_EVIC", "HIT_RATIO");
+    }
+
+    for (size_t i = 0; i < sweep->num_instances; i++) {
+        struct sweep_instance *instance = &sweep->instances[i];
+        struct cache_config *c = &instance->config;
+        struct cache_system_stats *s = &instance->cache_system->stats;
+        double hit_ratio = (double)s->hits / s->accesses;
+
+        if (instance->status != 0) {
+            fprintf(stderr, "Simulation of %s:%u:%u:%u:%s:%u failed\n", c->replacement_policy,
+                    c->cache_size, c->cache_lines, c->associativity, c->prefetcher,
+                    c->prefetch_amount);
+            continue;
+        }
+
+        if (csv) {
+            printf("%s,%u,%u,%u,%s,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.8f\n",
+                   c->replacement_policy, c->cache_size, c->cache_lines, c->associativity,
+                   c->prefetcher, c->prefetch_amount, (unsigned long long)s->accesses,
+                   (unsigned long long)s->hits, (unsigned long long)s->misses,
+                   (unsigned long long)s->prefetches, (unsigned long long)s->compulsory_misses,
+                   (unsigned long long)s->conflict_misses, (unsigned long long)s->dirty_evictions,
+                   hit_ratio);
+        } else {
+            printf("%-18s %10u %8u %6u %-10s %6u %10llu %10llu %10llu %10llu %10llu %10llu "
+                   "%10llu %10.8f\n",
+                   c->replacement_policy, c->cache_size, c->cache_lines, c->associativity,
+                   c->prefetcher, c->prefetch_amount, (unsigned long long)s->accesses,
+                   (unsigned long long)s->hits, (unsigned long long)s->misses,
+                   (unsigned long long)s->prefetches, (unsigned long long)s->compulsory_misses,
+                   (unsigned long long)s->conflict_misses, (unsigned long long)s->dirty_evictions,
+                   hit_ratio);
+        }
+    }
+}
+
+int sweep_main(int argc, char **argv)
+{
+    struct sweep sweep;
+    memset(&sweep, 0, sizeof(sweep));
+    char *trace_path = NULL;
+    bool csv = false;
+    long jobs = 1;
+    uint64_t seed = 0;
+    uint32_t prefetch_distance = CONFIG_DEFAULT_PREFETCH_DISTANCE;
+    bool prefetch_filter = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:c:j:s:d:f", sweep_long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'c':
+            if (!sweep_add_config_file(&sweep, optarg)) return 1;
+            break;
+        case 'j':
+            jobs = strtol(optarg, NULL, 10);
+            if (jobs < 0) {
+                fprintf(stderr, "Invalid number of jobs %s\n", optarg);
+                return 1;
+            }
+            if (jobs == 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'd':
+            if (!parse_uint32(optarg, &prefetch_distance) || prefetch_distance == 0) {
+                fprintf(stderr, "Invalid prefetch distance %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            prefetch_filter = true;
+            break;
+        case 'C':
+            csv = true;
+            break;
+        default:
+            return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!sweep_add_spec(&sweep, argv[i], ":")) return 1;
+    }
+    if (sweep.num_instances == 0) {
+        fprintf(stderr, "No configurations to sweep.\n");
+        return 1;
+    }
+
+    // The per-access output of many cache systems would be unreadable, so
+    // only the results table is printed.
+    verbosity = VERBOSITY_SILENT;
+
+    // Seed each instance from its position in the sweep (not from the thread
+    // that simulates it) so that the results are the same for any number of
+    // jobs.
+    for (size_t i = 0; i < sweep.num_instances; i++) {
+        sweep.instances[i].config.seed = seed + i;
+        sweep.instances[i].config.prefetch_distance = prefetch_distance;
+        sweep.instances[i].config.prefetch_filter = prefetch_filter;
+        sweep.instances[i].cache_system = cache_system_from_config(&sweep.instances[i].config);
+        if (sweep.instances[i].cache_system == NULL) return 1;
+    }
+
+    sweep.trace = trace_reader_open(trace_path);
+    if (sweep.trace == NULL) return 1;
+
+    // Read the trace once, and drive every instance from each batch.
+    sweep.num_threads = jobs < (long)sweep.num_instances ? jobs : sweep.num_instances;
+    if (sweep.num_threads == 0) sweep.num_threads = 1;
+    sweep_run(&sweep);
+    if (trace_reader_close(sweep.trace) != 0) return 1;
+
+    sweep_print_results(&sweep, csv);
+
+    int status = 0;
+    for (size_t i = 0; i < sweep.num_instances; i++) {
+        status |= sweep.instances[i].status;
+        cache_system_destroy(sweep.instances[i].cache_system);
+    }
+    free(sweep.instances);
+    return status;
+}
@@ -0,0 +1,63 @@
+//
+// This file defines the sweep mode of cachesim, which simulates many cache
+// configurations in a single pass over a trace.
+//
+// Usage:
+//      cachesim sweep [options] SPEC...
+//
+// Each SPEC has the same six fields as the normal cachesim arguments,
+// separated by colons, and any field may be a comma-separated list. The sweep
+// covers every combination of the listed values. For example
+//
+//      cachesim sweep LRU,RAND:1024,32768:128:1,2,4:NULL:0
+//
+// simulates 2 * 2 * 1 * 3 * 1 * 1 = 12 configurations.
+//
+// Options:
+//      -t, --trace FILE    read the trace from FILE instead of stdin
+//      -c, --config FILE   read additional SPECs from FILE, one per line, with
+//                          the fields separated by colons or whitespace
+//      -j, --jobs N        simulate on N threads (0 for one per CPU, default 1)
+//      -s, --seed N        base seed for random replacement decisions. Each
+//                          configuration gets its own generator, seeded from
+//                          this and its position in the sweep (default 0)
+//      -d, --prefetch-distance N
+//                          how many strides ahead of a stream the CUSTOM
+//                          prefetcher starts, for every configuration
+//                          (default 1)
+//      -f, --prefetch-filter
+//                          drop redundant prefetches in every configuration
+//      --csv               print the results as CSV instead of a table
+//
+// With more than one job, the configurations are divided between a pool of
+// worker threads. The trace is still read once: each batch is shared
+// read-only by all workers, and each worker feeds it to its own
+// configurations. The results do not depend on the number of jobs. If some of
+// the threads cannot be started, the sweep warns and runs on the others.
+//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stddef.h>
+
+#include "config.h"
+#include "trace.h"
+
+// One configuration in a sweep and the cache system simulating it.
+struct sweep_instance {
+    struct cache_config config;
+    struct cache_system *cache_system;
+    int status; // Non-zero once the cache system has reported an error.
+};
+
+// Feed a batch of records to every stride-th instance starting at first, one
+// instance at a time, so the batch stays in the CPU cache while each instance
+// consumes it.
+void sweep_run_batch(struct sweep_instance *instances, size_t num_instances, size_t first,
+                     size_t stride, const struct trace_record *records, size_t count);
+
+// The entrypoint for `cachesim sweep`. argv[0] is "sweep".
+int sweep_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,620 @@
+//
+// This file contains the implementations for the trace readers and writer
+// defined in trace.h.
+//
+
+#include "trace.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TRACE_READ_BUFFER_SIZE (1 << 20)
+#define TRACE_RING_SIZE 4 // Decoded batches in flight between the two threads
+
+extern char **environ;
+
+enum trace_source {
+    TRACE_SOURCE_TEXT,   // Text trace read through a buffer and parsed.
+    TRACE_SOURCE_STREAM, // Binary trace read through a buffer (e.g. a pipe).
+    TRACE_SOURCE_MAPPED, // Binary trace memory-mapped from a regular file.
+};
+
+// The compressed formats, recognized by their magic bytes and decompressed by
+// running "PROGRAM -dc".
+struct trace_decompressor {
+    const char *program;
+    const char *magic;
+    size_t magic_size;
+};
+
+static const struct trace_decompressor trace_decompressors[] = {
+    {"gzip", "\x1f\x8b", 2},
+    {"zstd", "\x28\xb5\x2f\xfd", 4},
+    {"xz", "\xfd" "7zXZ", 5},
+};
+
+struct trace_reader {
+    enum trace_source source;
+    FILE *file;
+    bool close_file;
+
+    // The decompressor (and the process feeding it what was already read from
+    // a pipe) if the trace is compressed, or 0.
+    const char *decompressor_program;
+    pid_t decompressor, feeder;
+
+    // Raw input buffer for the text and stream sources.
+    char *buffer;
+    size_t buffer_pos, buffer_len;
+    bool eof;
+    uint64_t line; // The line of a text trace that is being parsed
+
+    // Lines of a text trace that are not accesses, which are skipped, and
+    // addresses that are too wide for a record, which are truncated.
+    uint64_t malformed_lines, first_malformed_line;
+    uint64_t wide_addresses, first_wide_address_line;
+
+    // Set when the input could not be read to its end, e.g. after a read
+    // error or in a truncated binary trace. Decompressor failures are only
+    // found out when the reader is closed.
+    bool failed;
+
+    // The text and stream sources are decoded on a producer thread into a ring
+    // of batches. batches[tail % TRACE_RING_SIZE] is the oldest batch not yet
+    // released by the consumer, and head - tail batches are ready or in use.
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t produced, consumed;
+    struct trace_record *batches[TRACE_RING_SIZE];
+    size_t counts[TRACE_RING_SIZE];
+    uint64_t head, tail;
+    bool holding; // Whether the consumer is still using batch tail
+    bool stop;    // Tells the producer to exit
+
+    // The mapping for the mapped source.
+    void *mapping;
+    size_t mapping_size;
+    const struct trace_record *mapped_records;
+    size_t mapped_count, mapped_pos;
+};
+
+struct trace_writer {
+    FILE *file;
+    uint64_t record_count;
+    uint32_t flags;
+};
+
+// Reading traces
+// ============================================================================
+static bool trace_reader_fill(struct trace_reader *reader)
+{
+    // Move any unconsumed bytes to the front of the buffer, then read more.
+    size_t remaining = reader->buffer_len - reader->buffer_pos;
+    memmove(reader->buffer, reader->buffer + reader->buffer_pos, remaining);
+    reader->buffer_pos = 0;
+    reader->buffer_len = remaining;
+
+    if (!reader->eof) {
+        size_t n = fread(reader->buffer + remaining, 1, TRACE_READ_BUFFER_SIZE - remaining,
+                         reader->file);
+        if (n == 0) {
+            reader->eof = true;
+            if (ferror(reader->file)) {
+                fprintf(stderr, "Could not read the trace\n");
+                reader->failed = true;
+            }
+        }
+        reader->buffer_len += n;
+    }
+    return reader->buffer_len > 0;
+}
+
+// Fill the buffer with at least the first len bytes of the input, if there
+// are that many.
+static void trace_reader_fill_prefix(struct trace_reader *reader, size_t len)
+{
+    while (reader->buffer_len < len && !reader->eof) trace_reader_fill(reader);
+}
+
+static bool trace_reader_map(struct trace_reader *reader)
+{
+    int fd = fileno(reader->file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    size_t size = st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) return false;
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    reader->mapping = mapping;
+    reader->mapping_size = size;
+    reader->mapped_records =
+        (const struct trace_record *)((const char *)mapping + sizeof(struct trace_header));
+    reader->mapped_count = (size - sizeof(struct trace_header)) / sizeof(struct trace_record);
+    reader->mapped_pos = 0;
+    if ((size - sizeof(struct trace_header)) % sizeof(struct trace_record) != 0) {
+        fprintf(stderr, "The trace ends in the middle of a record\n");
+        reader->failed = true;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Replace the input with the output of the decompressor. The decompressor
+// reads the file itself if it can be rewound. Otherwise (a pipe), a feeder
+// process passes it the bytes that were already read followed by the rest of
+// the input. The feeder only fails if it cannot read the input; if it cannot
+// write, the decompressor has stopped and reports that itself.
+static bool trace_reader_decompress(struct trace_reader *reader, const char *program)
+{
+    int input = fileno(reader->file);
+    int feed[2] = {-1, -1};
+    if (lseek(input, 0, SEEK_SET) != 0) {
+        if (pipe(feed) != 0) return false;
+        pid_t feeder = fork();
+        if (feeder == 0) {
+            close(feed[0]);
+            bool ok = write_all(feed[1], reader->buffer, reader->buffer_len);
+            ssize_t n = 0;
+            while (ok && (n = read(input, reader->buffer, TRACE_READ_BUFFER_SIZE)) > 0) {
+                ok = write_all(feed[1], reader->buffer, n);
+            }
+            _exit(n < 0 ? 1 : 0);
+        }
+        close(feed[1]);
+        if (feeder < 0) {
+            close(feed[0]);
+            return false;
+        }
+        reader->feeder = feeder;
+        input = feed[0];
+    }
+
+    int output[2];
+    if (pipe(output) != 0) {
+        if (feed[0] >= 0) close(feed[0]);
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, output[0]);
+    char *argv[] = {(char *)program, "-dc", NULL};
+    int error = posix_spawnp(&reader->decompressor, program, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(output[1]);
+    if (feed[0] >= 0) close(feed[0]);
+    if (error != 0) {
+        fprintf(stderr, "Could not run %s to decompress the trace\n", program);
+        reader->decompressor = 0;
+        close(output[0]);
+        return false;
+    }
+
+    if (reader->close_file) fclose(reader->file);
+    reader->file = fdopen(output[0], "rb");
+    reader->close_file = true;
+    reader->decompressor_program = program;
+    reader->buffer_pos = reader->buffer_len = 0;
+    reader->eof = false;
+    return true;
+}
+
+static void *trace_reader_produce(void *arg);
+
+struct trace_reader *trace_reader_open(const char *path)
+{
+    struct trace_reader *reader = calloc(1, sizeof(struct trace_reader));
+    if (path == NULL || !strcmp(path, "-")) {
+        reader->file = stdin;
+    } else {
+        reader->file = fopen(path, "rb");
+        if (reader->file == NULL) {
+            fprintf(stderr, "Could not open trace %s\n", path);
+            free(reader);
+            return NULL;
+        }
+        reader->close_file = true;
+    }
+
+    reader->buffer = malloc(TRACE_READ_BUFFER_SIZE);
+    reader->line = 1;
+    trace_reader_fill_prefix(reader, sizeof(struct trace_header));
+
+    // Compressed traces are decompressed by a child process, after which the
+    // format is detected from the decompressed bytes as usual.
+    for (size_t i = 0; i < sizeof(trace_decompressors) / sizeof(*trace_decompressors); i++) {
+        const struct trace_decompressor *decompressor = &trace_decompressors[i];
+        if (reader->buffer_len < decompressor->magic_size ||
+            memcmp(reader->buffer, decompressor->magic, decompressor->magic_size) != 0) {
+            continue;
+        }
+        if (!trace_reader_decompress(reader, decompressor->program)) {
+            trace_reader_close(reader);
+            return NULL;
+        }
+        trace_reader_fill_prefix(reader, sizeof(struct trace_header));
+        break;
+    }
+
+    bool is_binary = reader->buffer_len >= sizeof(struct trace_header) &&
+                     !memcmp(reader->buffer, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    if (!is_binary) {
+        reader->source = TRACE_SOURCE_TEXT;
+    } else {
+        struct trace_header header;
+        memcpy(&header, reader->buffer, sizeof(header));
+        if (header.version != TRACE_VERSION) {
+            fprintf(stderr, "Unsupported trace version %u\n", header.version);
+            trace_reader_close(reader);
+            return NULL;
+        }
+
+        if (trace_reader_map(reader)) {
+            reader->source = TRACE_SOURCE_MAPPED;
+            free(reader->buffer);
+            reader->buffer = NULL;
+            return reader;
+        }
+        reader->source = TRACE_SOURCE_STREAM;
+        reader->buffer_pos = sizeof(struct trace_header);
+    }
+
+    // Decode on a separate thread, so that reading (and decompressing and
+    // parsing) the trace overlaps with the simulation.
+    for (int i = 0; i < TRACE_RING_SIZE; i++) {
+        reader->batches[i] = malloc(TRACE_BATCH_SIZE * sizeof(struct trace_record));
+    }
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->produced, NULL);
+    pthread_cond_init(&reader->consumed, NULL);
+    if (pthread_create(&reader->thread, NULL, &trace_reader_produce, reader) != 0) {
+        fprintf(stderr, "Could not start the trace reader thread\n");
+        trace_reader_close(reader);
+        return NULL;
+    }
+    reader->threaded = true;
+    return reader;
+}
+
+static inline int hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Skip whitespace, counting the lines that end on the way.
+static inline const char *skip_space(const char *p, const char *end, uint64_t *line)
+{
+    for (; p < end && isspace((unsigned char)*p); p++) {
+        if (*p == '\n') (*line)++;
+    }
+    return p;
+}
+
+// Skip the rest of the line that p is on.
+static void trace_reader_skip_line(struct trace_reader *reader, const char *p)
+{
+    while (true) {
+        const char *end = reader->buffer + reader->buffer_len;
+        const char *newline = memchr(p, '\n', end - p);
+        if (newline != NULL) {
+            reader->buffer_pos = newline - reader->buffer;
+            return;
+        }
+        reader->buffer_pos = reader->buffer_len;
+        if (reader->eof || !trace_reader_fill(reader)) return;
+        p = reader->buffer;
+    }
+}
+
+// Parse up to TRACE_BATCH_SIZE text records of the form "R 0x1234" (one per
+// line, the 0x being optional) from the buffer into records. Lines whose flag
+// is not R or W, or that have no address, are counted and skipped rather than
+// guessed at. A core ID that is out of range stops the trace with an error.
+static size_t trace_reader_next_text(struct trace_reader *reader, struct trace_record *records)
+{
+    size_t count = 0;
+    while (count < TRACE_BATCH_SIZE && !reader->failed) {
+        // Make sure that a whole line is in the buffer. A line is never longer
+        // than a few dozen bytes, so refilling when close to the end suffices.
+        if (reader->buffer_len - reader->buffer_pos < 128 && !reader->eof)
+            trace_reader_fill(reader);
+
+        const char *p = reader->buffer + reader->buffer_pos;
+        const char *end = reader->buffer + reader->buffer_len;
+        p = skip_space(p, end, &reader->line);
+        if (p == end) {
+            reader->buffer_pos = reader->buffer_len;
+            break;
+        }
+
+        // An optional decimal core ID, separated from the rest by whitespace.
+        // It stops growing once it is out of range, so it cannot wrap around.
+        uint32_t core = 0;
+        const char *digits = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (core < TRACE_MAX_CORES) core = core * 10 + (*p - '0');
+            p++;
+        }
+        if (p == digits || p == end || !isspace((unsigned char)*p)) {
+            core = 0;
+            p = digits;
+        } else if (core >= TRACE_MAX_CORES) {
+            fprintf(stderr, "Line %llu of the trace: core ID %.*s is out of range (at most %d)\n",
+                    (unsigned long long)reader->line, (int)(p - digits), digits,
+                    TRACE_MAX_CORES - 1);
+            reader->failed = true;
+            break;
+        }
+        p = skip_space(p, end, &reader->line);
+
+        // The flag and the address have to be on the same line.
+        char rw = p < end ? *p++ : '\0';
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p + 1 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+
+        uint64_t address = 0;
+        int digit;
+        bool wide = false;
+        const char *hex = p;
+        while (p < end && (digit = hex_digit_value(*p)) >= 0) {
+            if (address > TRACE_RECORD_ADDRESS_MASK >> 4) wide = true;
+            address = (address << 4) | digit;
+            p++;
+        }
+
+        if ((rw != 'R' && rw != 'W') || p == hex) {
+            if (reader->malformed_lines++ == 0) reader->first_malformed_line = reader->line;
+            trace_reader_skip_line(reader, p);
+            continue;
+        }
+
+        if (wide && reader->wide_addresses++ == 0) {
+            reader->first_wide_address_line = reader->line;
+        }
+
+        reader->buffer_pos = p - reader->buffer;
+        records[count++] = trace_record_make_core(core, rw, address);
+    }
+    return count;
+}
+
+static size_t trace_reader_next_stream(struct trace_reader *reader, struct trace_record *records)
+{
+    size_t count = 0;
+    while (count < TRACE_BATCH_SIZE) {
+        while (reader->buffer_len - reader->buffer_pos < sizeof(struct trace_record) &&
+               !reader->eof) {
+            trace_reader_fill(reader);
+        }
+        if (reader->buffer_len - reader->buffer_pos < sizeof(struct trace_record)) {
+            if (reader->buffer_len > reader->buffer_pos && !reader->failed) {
+                fprintf(stderr, "The trace ends in the middle of a record\n");
+                reader->failed = true;
+            }
+            break;
+        }
+        size_t available = (reader->buffer_len - reader->buffer_pos) / sizeof(struct trace_record);
+        if (available > TRACE_BATCH_SIZE - count) available = TRACE_BATCH_SIZE - count;
+        memcpy(&records[count], reader->buffer + reader->buffer_pos,
+               available * sizeof(struct trace_record));
+        reader->buffer_pos += available * sizeof(struct trace_record);
+        count += available;
+    }
+    return count;
+}
+
+// The producer thread. It decodes batches into the free slots of the ring
+// until the input is exhausted, which it signals with an empty batch.
+static void *trace_reader_produce(void *arg)
+{
+    struct trace_reader *reader = arg;
+    while (true) {
+        pthread_mutex_lock(&reader->lock);
+        while (reader->head - reader->tail == TRACE_RING_SIZE && !reader->stop) {
+            pthread_cond_wait(&reader->consumed, &reader->lock);
+        }
+        bool stop = reader->stop;
+        uint32_t slot = reader->head % TRACE_RING_SIZE;
+        pthread_mutex_unlock(&reader->lock);
+        if (stop) break;
+
+        struct trace_record *records = reader->batches[slot];
+        size_t count = reader->source == TRACE_SOURCE_TEXT
+                           ? trace_reader_next_text(reader, records)
+                           : trace_reader_next_stream(reader, records);
+
+        pthread_mutex_lock(&reader->lock);
+        reader->counts[slot] = count;
+        reader->head++;
+        pthread_cond_signal(&reader->produced);
+        pthread_mutex_unlock(&reader->lock);
+        if (count == 0) break;
+    }
+    return NULL;
+}
+
+size_t trace_reader_next(struct trace_reader *reader, const struct trace_record **records)
+{
+    if (reader->source == TRACE_SOURCE_MAPPED) {
+        // Hand out slices of the mapping directly.
+        size_t count = reader->mapped_count - reader->mapped_pos;
+        if (count > TRACE_BATCH_SIZE) count = TRACE_BATCH_SIZE;
+        *records = reader->mapped_records + reader->mapped_pos;
+        reader->mapped_pos += count;
+        return count;
+    }
+
+    // Release the previous batch and wait for the next one. The final, empty
+    // batch is never released, so every later call returns 0 too.
+    pthread_mutex_lock(&reader->lock);
+    if (reader->holding) {
+        reader->tail++;
+        reader->holding = false;
+        pthread_cond_signal(&reader->consumed);
+    }
+    while (reader->head == reader->tail) pthread_cond_wait(&reader->produced, &reader->lock);
+    uint32_t slot = reader->tail % TRACE_RING_SIZE;
+    size_t count = reader->counts[slot];
+    reader->holding = count > 0;
+    pthread_mutex_unlock(&reader->lock);
+
+    *records = reader->batches[slot];
+    return count;
+}
+
+bool trace_reader_is_binary(struct trace_reader *reader)
+{
+    return reader->source != TRACE_SOURCE_TEXT;
+}
+
+// Wait for a child process, returning whether it failed. Being stopped by
+// SIGPIPE is not a failure, since that happens whenever the trace is closed
+// before the child has written all of its output.
+static bool trace_reader_wait(pid_t pid)
+{
+    int status;
+    if (waitpid(pid, &status, 0) != pid) return true;
+    if (WIFSIGNALED(status)) return WTERMSIG(status) != SIGPIPE;
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int trace_reader_close(struct trace_reader *reader)
+{
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stop = true;
+        pthread_cond_signal(&reader->consumed);
+        pthread_mutex_unlock(&reader->lock);
+        pthread_join(reader->thread, NULL);
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->produced);
+        pthread_cond_destroy(&reader->consumed);
+    }
+
+    if (reader->mapping) munmap(reader->mapping, reader->mapping_size);
+    if (reader->close_file) fclose(reader->file);
+
+    // Closing the pipe first stops a decompressor that still has output left,
+    // so its exit status only counts if all of its output was read. One that
+    // fails by itself (e.g. on a truncated trace) closes its output too, which
+    // looks just like the end of the trace until its status is checked.
+    if (reader->malformed_lines > 0) {
+        fprintf(stderr, "Skipped %llu malformed lines of the trace (the first is line %llu)\n",
+                (unsigned long long)reader->malformed_lines,
+                (unsigned long long)reader->first_malformed_line);
+    }
+    if (reader->wide_addresses > 0) {
+        fprintf(stderr,
+                "Truncated %llu addresses of the trace to %d bits (the first is on line %llu)\n",
+                (unsigned long long)reader->wide_addresses, TRACE_ADDRESS_BITS,
+                (unsigned long long)reader->first_wide_address_line);
+    }
+
+    bool failed = reader->failed;
+    if (reader->decompressor > 0 && trace_reader_wait(reader->decompressor) && reader->eof) {
+        fprintf(stderr, "%s failed to decompress the trace\n", reader->decompressor_program);
+        failed = true;
+    }
+    if (reader->feeder > 0 && trace_reader_wait(reader->feeder)) {
+        fprintf(stderr, "Could not read the compressed trace\n");
+        failed = true;
+    }
+
+    free(reader->buffer);
+    for (int i = 0; i < TRACE_RING_SIZE; i++) free(reader->batches[i]);
+    free(reader);
+    return failed ? 1 : 0;
+}
+
+// Writing binary traces
+// ============================================================================
+struct trace_writer *trace_writer_open(const char *path)
+{
+    FILE *file = !strcmp(path, "-") ? stdout : fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return NULL;
+    }
+
+    struct trace_writer *writer = calloc(1, sizeof(struct trace_writer));
+    writer->file = file;
+
+    struct trace_header header = {.version = TRACE_VERSION};
+    memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    fwrite(&header, sizeof(header), 1, file);
+    return writer;
+}
+
+int trace_writer_append(struct trace_writer *writer, struct trace_record record)
+{
+    writer->record_count++;
+    if (trace_record_core(record) != 0) writer->flags |= TRACE_FLAG_MULTICORE;
+    return fwrite(&record, sizeof(record), 1, writer->file) == 1 ? 0 : 1;
+}
+
+int trace_writer_append_batch(struct trace_writer *writer, const struct trace_record *records,
+                              size_t count)
+{
+    writer->record_count += count;
+    for (size_t i = 0; i < count && !(writer->flags & TRACE_FLAG_MULTICORE); i++) {
+        if (trace_record_core(records[i]) != 0) writer->flags |= TRACE_FLAG_MULTICORE;
+    }
+    return fwrite(records, sizeof(*records), count, writer->file) == count ? 0 : 1;
+}
+
+int trace_writer_close(struct trace_writer *writer)
+{
+    // Fill in the flags and record count if the output is seekable. Readers
+    // never rely on them, so it is fine to leave them as zero when writing to
+    // a pipe.
+    FILE *file = writer->file;
+    if (fseek(file, offsetof(struct trace_header, flags), SEEK_SET) == 0) {
+        fwrite(&writer->flags, sizeof(writer->flags), 1, file);
+        fwrite(&writer->record_count, sizeof(writer->record_count), 1, file);
+    }
+
+    int status = ferror(file) ? 1 : 0;
+    if (file == stdout) {
+        status |= fflush(file) != 0;
+    } else {
+        status |= fclose(file) != 0;
+    }
+    free(writer);
+    return status;
+}
+
+void trace_writer_discard(struct trace_writer *writer)
+{
+    if (writer->file == stdout) {
+        fflush(writer->file);
+    } else {
+        fclose(writer->file);
+    }
+    free(writer);
+}
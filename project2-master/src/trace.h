@@ -0,0 +1,145 @@
+//
+// This file defines the binary trace format and the trace reader used to feed
+// memory accesses into the cache system.
+//
+// A binary trace is a fixed-size header followed by one 64-bit little-endian
+// record per memory access. Bit 63 of a record is set for writes, bits 56-62
+// hold the ID of the core making the access (0 in single-core traces), and
+// bits 0-55 hold the address. Traces can therefore only hold 56-bit addresses,
+// even though the simulator itself works with 64-bit ones; wider addresses in
+// text traces lose their top bits, with a warning. Because every record has the same width, a
+// binary trace can be memory-mapped and handed to the simulator without any
+// per-record parsing.
+//
+// The reader also accepts the original text format ("R 0x1234" per line), so
+// callers do not need to care which kind of trace they were given. Lines of
+// multi-core text traces start with the decimal core ID ("3 R 0x1234"), which
+// must be below TRACE_MAX_CORES.
+//
+// Either kind of trace may also be compressed with gzip, zstd or xz. This is
+// detected from the magic bytes, and the trace is decompressed by running the
+// matching program, which must be on the PATH. Traces that are not
+// memory-mapped (text, compressed or piped traces) are decompressed, read and
+// parsed on a producer thread, so that this work overlaps with the
+// simulation.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC "CSTRACE1"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+
+#define TRACE_ADDRESS_BITS 56
+
+#define TRACE_RECORD_WRITE_BIT (UINT64_C(1) << 63)
+#define TRACE_RECORD_CORE_SHIFT TRACE_ADDRESS_BITS
+#define TRACE_RECORD_CORE_MASK (UINT64_C(0x7f) << TRACE_RECORD_CORE_SHIFT)
+#define TRACE_RECORD_ADDRESS_MASK ((UINT64_C(1) << TRACE_RECORD_CORE_SHIFT) - 1)
+#define TRACE_MAX_CORES 128
+
+// Header flags
+#define TRACE_FLAG_MULTICORE (1 << 0) // Some records have a non-zero core ID
+
+// The number of records handed out per call to trace_reader_next.
+#define TRACE_BATCH_SIZE 65536
+
+// The header at the start of every binary trace file.
+struct trace_header {
+    char magic[TRACE_MAGIC_SIZE]; // Always TRACE_MAGIC (not NUL terminated)
+    uint32_t version;             // TRACE_VERSION
+    uint32_t flags;               // TRACE_FLAG_* bits
+    uint64_t record_count;        // Number of records following the header
+};
+
+// A single memory access.
+struct trace_record {
+    uint64_t bits;
+};
+
+static inline struct trace_record trace_record_make(char rw, uint64_t address)
+{
+    struct trace_record record = {(address & TRACE_RECORD_ADDRESS_MASK) |
+                                  (rw == 'W' ? TRACE_RECORD_WRITE_BIT : 0)};
+    return record;
+}
+
+// core must be below TRACE_MAX_CORES; the trace readers reject larger IDs
+// instead of letting them wrap around.
+static inline struct trace_record trace_record_make_core(uint32_t core, char rw, uint64_t address)
+{
+    struct trace_record record = trace_record_make(rw, address);
+    record.bits |= ((uint64_t)core << TRACE_RECORD_CORE_SHIFT) & TRACE_RECORD_CORE_MASK;
+    return record;
+}
+
+static inline uint64_t trace_record_address(struct trace_record record)
+{
+    return record.bits & TRACE_RECORD_ADDRESS_MASK;
+}
+
+static inline char trace_record_rw(struct trace_record record)
+{
+    return (record.bits & TRACE_RECORD_WRITE_BIT) ? 'W' : 'R';
+}
+
+static inline uint32_t trace_record_core(struct trace_record record)
+{
+    return (record.bits & TRACE_RECORD_CORE_MASK) >> TRACE_RECORD_CORE_SHIFT;
+}
+
+// Reading traces
+// ============================================================================
+struct trace_reader;
+
+// Open a trace for reading. If path is NULL or "-", the trace is read from
+// stdin. The format (text or binary, and the compression) is detected from the
+// first bytes of the input. Uncompressed binary traces in regular files are
+// memory-mapped. Returns NULL and prints an error if the trace cannot be
+// opened.
+struct trace_reader *trace_reader_open(const char *path);
+
+// Get the next batch of records. On return, *records points to an array of
+// the returned number of records, which stays valid until the next call.
+// Returns 0 once the trace is exhausted. Only one thread may call this.
+size_t trace_reader_next(struct trace_reader *reader, const struct trace_record **records);
+
+// Whether the trace being read is a binary trace.
+bool trace_reader_is_binary(struct trace_reader *reader);
+
+// Close the trace and free the reader. Returns non-zero if the trace could
+// not be read to its end (a read error, a truncated binary trace or a failed
+// decompressor), in which case the records handed out so far are not the
+// whole trace and the results should be discarded.
+int trace_reader_close(struct trace_reader *reader);
+
+// Writing binary traces
+// ============================================================================
+struct trace_writer;
+
+// Create a binary trace at the given path ("-" for stdout). Returns NULL and
+// prints an error on failure.
+struct trace_writer *trace_writer_open(const char *path);
+
+// Append a record to the trace. Returns 0 on success.
+int trace_writer_append(struct trace_writer *writer, struct trace_record record);
+
+// Append count records to the trace. Returns 0 on success.
+int trace_writer_append_batch(struct trace_writer *writer, const struct trace_record *records,
+                              size_t count);
+
+// Finish the trace, filling in the record count and flags in the header, and free the
+// writer. Returns 0 on success.
+int trace_writer_close(struct trace_writer *writer);
+
+// Close the trace without finishing its header, and free the writer. This is
+// for traces that turned out to be incomplete; the caller should delete them.
+void trace_writer_discard(struct trace_writer *writer);
+
+#endif
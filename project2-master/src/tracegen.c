@@ -0,0 +1,505 @@
+//
+// This file contains the implementation of the trace generator defined in
+// tracegen.h.
+//
+
+#include "tracegen.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rng.h"
+#include "trace.h"
+
+#define TRACEGEN_MAX_PATTERNS 16
+#define TRACEGEN_NODE_SIZE 64
+#define TRACEGEN_MAX_RUN 16
+
+// Each pattern gets its own region, so that the patterns in a mix do not
+// share lines. The regions start well above zero, like heap addresses.
+#define TRACEGEN_BASE (UINT64_C(1) << 44)
+#define TRACEGEN_REGION_SIZE (UINT64_C(1) << 40)
+
+// The Zipfian normalization constant is summed exactly over this many ranks,
+// and approximated with an integral beyond them.
+#define TRACEGEN_ZETA_EXACT_TERMS (1 << 20)
+
+enum tracegen_kind {
+    TRACEGEN_SEQ,
+    TRACEGEN_STRIDE,
+    TRACEGEN_CHASE,
+    TRACEGEN_ZIPF,
+    TRACEGEN_STACK,
+    TRACEGEN_NUM_KINDS,
+};
+
+static const char *tracegen_kind_names[TRACEGEN_NUM_KINDS] = {
+    "seq", "stride", "chase", "zipf", "stack",
+};
+
+struct tracegen_params {
+    uint64_t footprint, element, stride;
+    double skew, write_ratio;
+};
+
+struct tracegen_pattern {
+    enum tracegen_kind kind;
+    uint32_t weight;
+    uint64_t base, footprint;
+    struct rng rng;
+
+    // seq and stride: the offset of the next access, and for stride the
+    // offset of the current column. chase: the current node. stack: the
+    // depth in elements.
+    uint64_t position, column;
+
+    // The number of elements (or nodes) in the footprint.
+    uint64_t count;
+
+    // chase: the node following each node.
+    uint32_t *next;
+
+    // zipf: the constants of the generator (see tracegen_zipf_rank), and
+    // the multiplier that scatters the ranks through the footprint.
+    double zeta_n, alpha, eta, two_threshold;
+    uint64_t scatter;
+
+    // stack: the accesses left in the current run, and its direction.
+    uint32_t run;
+    bool pushing;
+};
+
+static const struct option tracegen_long_options[] = {
+    {"accesses", required_argument, NULL, 'n'},
+    {"output", required_argument, NULL, 'o'},
+    {"seed", required_argument, NULL, 's'},
+    {"footprint", required_argument, NULL, 'f'},
+    {"element", required_argument, NULL, 'e'},
+    {"stride", required_argument, NULL, 'S'},
+    {"skew", required_argument, NULL, 'z'},
+    {"write-ratio", required_argument, NULL, 'w'},
+    {"burst", required_argument, NULL, 'b'},
+    {"text", no_argument, NULL, 'T'},
+    {NULL, 0, NULL, 0},
+};
+
+// Helpers
+// ============================================================================
+// Returns a number in [0, 1).
+static inline double rng_double(struct rng *rng)
+{
+    return (rng_next(rng) >> 11) * 0x1p-53;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Parse a count or size with an optional k, M or G suffix.
+static bool parse_size(const char *str, uint64_t *out)
+{
+    char *endptr;
+    uint64_t value = strtoull(str, &endptr, 10);
+    if (endptr == str) return false;
+    switch (*endptr) {
+    case 'k':
+    case 'K':
+        value <<= 10;
+        endptr++;
+        break;
+    case 'm':
+    case 'M':
+        value <<= 20;
+        endptr++;
+        break;
+    case 'g':
+    case 'G':
+        value <<= 30;
+        endptr++;
+        break;
+    }
+    if (*endptr != '\0') return false;
+    *out = value;
+    return true;
+}
+
+// The generalized harmonic number H(n, theta) = sum of 1 / i^theta for i from
+// 1 to n.
+static double zeta(uint64_t n, double theta)
+{
+    uint64_t exact = n < TRACEGEN_ZETA_EXACT_TERMS ? n : TRACEGEN_ZETA_EXACT_TERMS;
+    double sum = 0;
+    for (uint64_t i = 1; i <= exact; i++) sum += pow(i, -theta);
+    if (n > exact) {
+        // The integral of x^-theta from exact + 1/2 to n + 1/2 is within a
+        // tiny fraction of the remaining terms.
+        sum += (pow(n + 0.5, 1 - theta) - pow(exact + 0.5, 1 - theta)) / (1 - theta);
+    }
+    return sum;
+}
+
+// Patterns
+// ============================================================================
+static bool tracegen_pattern_init(struct tracegen_pattern *pattern,
+                                  const struct tracegen_params *params)
+{
+    uint64_t footprint = pattern->footprint;
+    if (footprint < params->element || footprint > TRACEGEN_REGION_SIZE) {
+        fprintf(stderr, "The footprint of %s must be between the element size and 1 TiB\n",
+                tracegen_kind_names[pattern->kind]);
+        return false;
+    }
+    pattern->count = footprint / params->element;
+
+    switch (pattern->kind) {
+    case TRACEGEN_SEQ:
+    case TRACEGEN_STRIDE:
+        break;
+
+    case TRACEGEN_CHASE: {
+        // Sattolo's algorithm turns the identity into a random permutation
+        // with a single cycle, so the chase visits every node before it
+        // repeats.
+        pattern->count = footprint / TRACEGEN_NODE_SIZE;
+        if (pattern->count == 0 || pattern->count > UINT32_MAX) {
+            fprintf(stderr, "The footprint of chase must hold between 1 and 2^32 - 1 nodes\n");
+            return false;
+        }
+        uint32_t nodes = pattern->count;
+        pattern->next = malloc(nodes * sizeof(uint32_t));
+        for (uint32_t i = 0; i < nodes; i++) pattern->next[i] = i;
+        for (uint32_t i = nodes - 1; i > 0; i--) {
+            uint32_t j = rng_below(&pattern->rng, i);
+            uint32_t t = pattern->next[i];
+            pattern->next[i] = pattern->next[j];
+            pattern->next[j] = t;
+        }
+        break;
+    }
+
+    case TRACEGEN_ZIPF: {
+        // The constants of the generator from Gray et al., "Quickly
+        // Generating Billion-Record Synthetic Databases".
+        double theta = params->skew, n = pattern->count;
+        pattern->zeta_n = zeta(pattern->count, theta);
+        pattern->alpha = 1 / (1 - theta);
+        pattern->eta = (1 - pow(2 / n, 1 - theta)) / (1 - zeta(2, theta) / pattern->zeta_n);
+        pattern->two_threshold = 1 + pow(0.5, theta);
+
+        // Any multiplier coprime to the element count maps the ranks onto the
+        // elements one to one. Start near the golden ratio of the count, so
+        // that consecutive ranks land far apart.
+        uint64_t scatter = (uint64_t)(n * 0.6180339887) | 1;
+        while (gcd(scatter, pattern->count) != 1) scatter += 2;
+        pattern->scatter = scatter % pattern->count;
+        break;
+    }
+
+    case TRACEGEN_STACK:
+        pattern->run = 0;
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+static void tracegen_pattern_cleanup(struct tracegen_pattern *pattern)
+{
+    free(pattern->next);
+}
+
+static uint64_t tracegen_zipf_rank(struct tracegen_pattern *pattern)
+{
+    double u = rng_double(&pattern->rng);
+    double uz = u * pattern->zeta_n;
+    if (uz < 1) return 0;
+    if (uz < pattern->two_threshold) return 1;
+    uint64_t rank = pattern->count * pow(pattern->eta * u - pattern->eta + 1, pattern->alpha);
+    return rank < pattern->count ? rank : pattern->count - 1;
+}
+
+static struct trace_record tracegen_pattern_next(struct tracegen_pattern *pattern,
+                                                 const struct tracegen_params *params)
+{
+    uint64_t element = params->element;
+    uint64_t offset;
+    char rw = rng_double(&pattern->rng) < params->write_ratio ? 'W' : 'R';
+
+    switch (pattern->kind) {
+    case TRACEGEN_SEQ:
+        offset = pattern->position;
+        pattern->position += element;
+        if (pattern->position + element > pattern->footprint) pattern->position = 0;
+        break;
+
+    case TRACEGEN_STRIDE:
+        // Walk down a column of the array, then move on to the next one.
+        offset = pattern->position;
+        pattern->position += params->stride;
+        if (pattern->position + element > pattern->footprint) {
+            pattern->column += element;
+            if (pattern->column + element > params->stride) pattern->column = 0;
+            pattern->position = pattern->column;
+        }
+        break;
+
+    case TRACEGEN_CHASE:
+        offset = pattern->position * TRACEGEN_NODE_SIZE;
+        pattern->position = pattern->next[pattern->position];
+        rw = 'R';
+        break;
+
+    case TRACEGEN_ZIPF: {
+        uint64_t rank = tracegen_zipf_rank(pattern);
+        offset = (uint64_t)((unsigned __int128)rank * pattern->scatter % pattern->count) * element;
+        break;
+    }
+
+    case TRACEGEN_STACK:
+        // Pick the direction and length of the next run, turning around at
+        // the ends of the stack.
+        if (pattern->run == 0) {
+            pattern->run = 1 + rng_below(&pattern->rng, TRACEGEN_MAX_RUN);
+            pattern->pushing = rng_below(&pattern->rng, 2);
+        }
+        pattern->run--;
+        if (pattern->position == 0) pattern->pushing = true;
+        if (pattern->position == pattern->count) pattern->pushing = false;
+
+        // The stack grows down from the top of the region.
+        if (pattern->pushing) {
+            pattern->position++;
+            offset = pattern->footprint - pattern->position * element;
+            rw = 'W';
+        } else {
+            offset = pattern->footprint - pattern->position * element;
+            pattern->position--;
+            rw = 'R';
+        }
+        break;
+
+    default:
+        offset = 0;
+        break;
+    }
+
+    return trace_record_make(rw, pattern->base + offset);
+}
+
+// Main
+// ============================================================================
+// Parse PATTERN[:WEIGHT[:FOOTPRINT]] into one pattern, or every pattern for
+// "mix".
+static bool tracegen_parse_pattern(const char *spec, const struct tracegen_params *params,
+                                   struct tracegen_pattern *patterns, size_t *num_patterns)
+{
+    char name[32];
+    size_t name_len = strcspn(spec, ":");
+    if (name_len >= sizeof(name)) name_len = sizeof(name) - 1;
+    memcpy(name, spec, name_len);
+    name[name_len] = '\0';
+
+    uint64_t weight = 1, footprint = params->footprint;
+    if (spec[name_len] == ':') {
+        const char *weight_str = spec + name_len + 1;
+        char *endptr;
+        weight = strtoull(weight_str, &endptr, 10);
+        bool valid = endptr != weight_str && weight > 0 && weight <= UINT16_MAX;
+        if (*endptr == ':') {
+            valid = valid && parse_size(endptr + 1, &footprint);
+        } else {
+            valid = valid && *endptr == '\0';
+        }
+        if (!valid) {
+            fprintf(stderr, "Invalid pattern %s\n", spec);
+            return false;
+        }
+    }
+
+    int first = TRACEGEN_NUM_KINDS, last = TRACEGEN_NUM_KINDS;
+    if (!strcmp(name, "mix")) {
+        first = 0;
+    } else {
+        for (int kind = 0; kind < TRACEGEN_NUM_KINDS; kind++) {
+            if (!strcmp(name, tracegen_kind_names[kind])) {
+                first = kind;
+                last = kind + 1;
+            }
+        }
+    }
+    if (first == TRACEGEN_NUM_KINDS) {
+        fprintf(stderr, "Unknown pattern %s\n", name);
+        return false;
+    }
+
+    for (int kind = first; kind < last; kind++) {
+        if (*num_patterns == TRACEGEN_MAX_PATTERNS) {
+            fprintf(stderr, "Too many patterns (at most %d)\n", TRACEGEN_MAX_PATTERNS);
+            return false;
+        }
+        struct tracegen_pattern *pattern = &patterns[(*num_patterns)++];
+        pattern->kind = kind;
+        pattern->weight = weight;
+        pattern->footprint = footprint;
+    }
+    return true;
+}
+
+static int tracegen_write_text(FILE *out, const struct trace_record *records, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "%c 0x%llx\n", trace_record_rw(records[i]),
+                (unsigned long long)trace_record_address(records[i]));
+    }
+    return ferror(out) ? 1 : 0;
+}
+
+int tracegen_main(int argc, char **argv)
+{
+    struct tracegen_params params = {
+        .footprint = 64 << 20,
+        .element = 8,
+        .stride = 4096,
+        .skew = 0.99,
+        .write_ratio = 0.25,
+    };
+    uint64_t accesses = 1 << 20, seed = 0, burst = 16;
+    const char *output_path = "-";
+    bool text = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:o:s:f:e:S:z:w:b:", tracegen_long_options, NULL)) !=
+           -1) {
+        bool valid = true;
+        switch (opt) {
+        case 'n':
+            valid = parse_size(optarg, &accesses);
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            valid = parse_size(optarg, &params.footprint);
+            break;
+        case 'e':
+            valid = parse_size(optarg, &params.element) && params.element > 0;
+            break;
+        case 'S':
+            valid = parse_size(optarg, &params.stride) && params.stride > 0;
+            break;
+        case 'z':
+            params.skew = strtod(optarg, NULL);
+            valid = params.skew > 0 && params.skew < 1;
+            break;
+        case 'w':
+            params.write_ratio = strtod(optarg, NULL);
+            valid = params.write_ratio >= 0 && params.write_ratio <= 1;
+            break;
+        case 'b':
+            valid = parse_size(optarg, &burst) && burst > 0;
+            break;
+        case 'T':
+            text = true;
+            break;
+        default:
+            return 1;
+        }
+        if (!valid) {
+            fprintf(stderr, "Invalid value %s\n", optarg);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: cachesim gen [options] PATTERN[:WEIGHT[:FOOTPRINT]]...\n");
+        return 1;
+    }
+    if (params.stride < params.element) {
+        fprintf(stderr, "The stride must be at least the element size\n");
+        return 1;
+    }
+
+    // Set up the patterns, each with its own generator and region.
+    struct tracegen_pattern patterns[TRACEGEN_MAX_PATTERNS] = {0};
+    size_t num_patterns = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!tracegen_parse_pattern(argv[i], &params, patterns, &num_patterns)) return 1;
+    }
+    uint32_t total_weight = 0;
+    bool valid = true;
+    for (size_t i = 0; i < num_patterns; i++) {
+        patterns[i].base = TRACEGEN_BASE + i * TRACEGEN_REGION_SIZE;
+        rng_seed(&patterns[i].rng, rng_mix(seed) + i + 1);
+        valid = tracegen_pattern_init(&patterns[i], &params) && valid;
+        total_weight += patterns[i].weight;
+    }
+
+    // Open the output.
+    struct trace_writer *writer = NULL;
+    FILE *out = NULL;
+    if (valid && text) {
+        out = !strcmp(output_path, "-") ? stdout : fopen(output_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Could not open %s for writing\n", output_path);
+            valid = false;
+        }
+    } else if (valid) {
+        writer = trace_writer_open(output_path);
+        valid = writer != NULL;
+    }
+    if (!valid) {
+        for (size_t i = 0; i < num_patterns; i++) tracegen_pattern_cleanup(&patterns[i]);
+        return 1;
+    }
+
+    // Generate the trace a batch at a time.
+    struct rng rng;
+    rng_seed(&rng, seed);
+    struct trace_record *records = malloc(TRACE_BATCH_SIZE * sizeof(struct trace_record));
+    struct tracegen_pattern *pattern = &patterns[0];
+    uint64_t burst_left = 0;
+    int status = 0;
+    while (status == 0 && accesses > 0) {
+        size_t count = accesses < TRACE_BATCH_SIZE ? accesses : TRACE_BATCH_SIZE;
+        for (size_t i = 0; i < count; i++) {
+            if (burst_left == 0) {
+                uint32_t pick = rng_below(&rng, total_weight);
+                pattern = &patterns[0];
+                while (pick >= pattern->weight) pick -= (pattern++)->weight;
+                burst_left = burst;
+            }
+            burst_left--;
+            records[i] = tracegen_pattern_next(pattern, &params);
+        }
+        if (text) {
+            status = tracegen_write_text(out, records, count);
+        } else {
+            status = trace_writer_append_batch(writer, records, count);
+        }
+        accesses -= count;
+    }
+    free(records);
+
+    // Clean everything up.
+    if (writer != NULL) status |= trace_writer_close(writer);
+    if (out != NULL && out != stdout) status |= fclose(out) != 0;
+    if (out == stdout) status |= fflush(out) != 0;
+    for (size_t i = 0; i < num_patterns; i++) tracegen_pattern_cleanup(&patterns[i]);
+    if (status) fprintf(stderr, "Failed to write %s\n", output_path);
+    return status;
+}
@@ -0,0 +1,53 @@
+//
+// This file defines the trace generator, which produces synthetic workloads
+// that are much larger than the bundled traces. The same seed and arguments
+// always produce the same trace.
+//
+// Usage:
+//      cachesim gen [options] PATTERN[:WEIGHT[:FOOTPRINT]]...
+//
+// The patterns are:
+//      seq       a sequential scan, one element after the other
+//      stride    a scan with a fixed stride (a column-major walk of an array)
+//      chase     pointer chasing around a random cycle of line-sized nodes
+//      zipf      Zipfian accesses to the elements of a hot set, with the
+//                popular elements scattered through the footprint
+//      stack     runs of pushes (writes) and pops (reads) on a stack
+//      mix       all of the above, with equal weights
+//
+// Giving several patterns mixes them. Each pattern works on its own region of
+// memory, and every burst of accesses comes from a pattern picked at random in
+// proportion to the weights (default 1). FOOTPRINT overrides --footprint for
+// one pattern. For example
+//
+//      cachesim gen -n 1G zipf:3:16M seq | cachesim -q LRU 32768 512 8 NULL 0
+//
+// simulates a billion accesses, three quarters of them to a 16 MiB Zipfian
+// hot set and the rest a scan of 64 MiB.
+//
+// Options:
+//      -n, --accesses N      the number of accesses to generate (default 1M)
+//      -o, --output FILE     write the trace to FILE instead of stdout
+//      -s, --seed N          seed for the random choices (default 0)
+//      -f, --footprint BYTES the size of each pattern's region (default 64M)
+//      -e, --element BYTES   the size of an element (default 8)
+//      -S, --stride BYTES    the stride of the stride pattern (default 4096)
+//      -z, --skew THETA      the skew of the zipf pattern, in (0, 1)
+//                            (default 0.99)
+//      -w, --write-ratio R   the fraction of the seq, stride and zipf accesses
+//                            that are writes (default 0.25). Pointer chasing
+//                            only reads, and the stack writes when it pushes.
+//      -b, --burst N         the number of consecutive accesses taken from a
+//                            pattern before picking another (default 16)
+//      --text                write a text trace instead of a binary one
+//
+// Counts and sizes may have a k, M or G suffix (powers of 1024).
+//
+
+#ifndef TRACEGEN_H
+#define TRACEGEN_H
+
+// The entrypoint for `cachesim gen`. argv[0] is "gen".
+int tracegen_main(int argc, char **argv);
+
+#endif
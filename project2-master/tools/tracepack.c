@@ -0,0 +1,114 @@
+//
+// This is the tracepack tool. It converts text traces (as read by cachesim on
+// stdin) into the binary trace format described in src/trace.h, and can dump
+// a binary trace back to text. Core IDs of multi-core traces are kept (and
+// dumped as a prefix on lines with a non-zero core ID).
+//
+// Usage:
+//      tracepack [INPUT [OUTPUT]]      convert a text trace to a binary trace
+//      tracepack -d [INPUT [OUTPUT]]   dump a binary trace as text
+//
+// INPUT and OUTPUT default to stdin and stdout ("-" may also be used). INPUT
+// may be compressed (see src/trace.h). If INPUT cannot be read to its end
+// (e.g. a truncated compressed trace), the partial OUTPUT file is deleted.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+static int dump(struct trace_reader *reader, const char *output_path)
+{
+    FILE *out = !strcmp(output_path, "-") ? stdout : fopen(output_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s for writing\n", output_path);
+        return 1;
+    }
+
+    const struct trace_record *records;
+    size_t count;
+    while ((count = trace_reader_next(reader, &records)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t core = trace_record_core(records[i]);
+            if (core != 0) fprintf(out, "%u ", core);
+            fprintf(out, "%c 0x%llx\n", trace_record_rw(records[i]),
+                    (unsigned long long)trace_record_address(records[i]));
+        }
+    }
+
+    int status = ferror(out) ? 1 : 0;
+    if (out == stdout) {
+        status |= fflush(out) != 0;
+    } else {
+        status |= fclose(out) != 0;
+    }
+    if (status) fprintf(stderr, "Failed to write %s\n", output_path);
+    return status;
+}
+
+// Pack the trace and close the reader. A failed read (e.g. of a truncated
+// compressed trace) only shows when the reader is closed, so that happens
+// before the header is filled in. An incomplete output is deleted if it is a
+// regular file (not stdout or a device such as /dev/full).
+static int pack(struct trace_reader *reader, const char *output_path)
+{
+    struct trace_writer *writer = trace_writer_open(output_path);
+    if (writer == NULL) {
+        trace_reader_close(reader);
+        return 1;
+    }
+
+    const struct trace_record *records;
+    size_t count;
+    int write_status = 0;
+    while (write_status == 0 && (count = trace_reader_next(reader, &records)) > 0) {
+        write_status = trace_writer_append_batch(writer, records, count);
+    }
+
+    int read_status = trace_reader_close(reader);
+    if (read_status == 0 && write_status == 0) {
+        write_status = trace_writer_close(writer);
+    } else {
+        trace_writer_discard(writer);
+    }
+    if (write_status) fprintf(stderr, "Failed to write %s\n", output_path);
+    if (read_status || write_status) {
+        struct stat st;
+        if (strcmp(output_path, "-") && stat(output_path, &st) == 0 && S_ISREG(st.st_mode)) {
+            remove(output_path);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool dump_mode = argc > 1 && !strcmp(argv[1], "-d");
+    int first = dump_mode ? 2 : 1;
+    if (argc - first > 2) {
+        fprintf(stderr, "Usage: %s [-d] [INPUT [OUTPUT]]\n", argv[0]);
+        return 1;
+    }
+    const char *input_path = argc > first ? argv[first] : "-";
+    const char *output_path = argc > first + 1 ? argv[first + 1] : "-";
+
+    struct trace_reader *reader = trace_reader_open(input_path);
+    if (reader == NULL) return 1;
+
+    if (!dump_mode && !trace_reader_is_binary(reader)) return pack(reader, output_path);
+
+    int status;
+    if (dump_mode) {
+        status = dump(reader, output_path);
+    } else {
+        fprintf(stderr, "%s is already a binary trace\n", input_path);
+        status = 1;
+    }
+
+    status |= trace_reader_close(reader);
+    return status;
+}